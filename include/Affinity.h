@@ -0,0 +1,36 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Affinity.h
+ */
+
+#ifndef _AFFINITY_DEFINED
+#define _AFFINITY_DEFINED
+
+#include <iostream>
+
+/* Pin each thread of a team of numThreads OpenMP threads to one CPU the process
+ * may run on, as selected by PIN. CPUs are grouped into physical cores, ordered
+ * by package and core, from the sysfs topology:
+ *  PIN=compact - thread t runs on the t-th hardware thread, filling the SMT
+ *                siblings of a core before moving on to the next core
+ *  PIN=spread  - threads are spaced evenly across all cores, and so NUMA nodes,
+ *                one per core; SMT siblings are used only once every core has
+ *                a thread, all first siblings before any second one
+ * Threads beyond the hardware thread count wrap around. Later parallel regions
+ * must use the same numThreads, since OpenMP only reuses the pinned threads for
+ * teams no larger than this one. Must be called before particle and tree
+ * storage is first touched, so that its pages land on the NUMA nodes of the
+ * threads working on them. PIN is ignored when OMP_PROC_BIND already binds
+ * threads, and off Linux. */
+void pinThreads(int numThreads);
+
+/* Let the calling thread run on every CPU the process could before pinThreads.
+ * Threads created outside OpenMP, like the snapshot writer, would otherwise
+ * inherit the single CPU the master thread is pinned to. */
+void unpinThread();
+
+/* Print the CPU and NUMA node each thread of a team of numThreads runs on */
+void printPlacement(std::ostream &out, int numThreads);
+
+#endif // _AFFINITY_DEFINED
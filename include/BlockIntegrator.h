@@ -0,0 +1,64 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: BlockIntegrator.h
+ */
+
+#ifndef _BLOCKINTEGRATOR_DEFINED
+#define _BLOCKINTEGRATOR_DEFINED
+
+#include <vector>
+#include "LinearOctTree.h"
+#include "Particles.h"
+
+constexpr int MAX_STEP_SPAN = 2;    // default longest step: delta * 2^2
+constexpr int MAX_STEP_LEVELS = 6;  // default shortest step: delta / 2^6
+constexpr double STEP_ETA = 0.1;    // default time step accuracy parameter
+
+// Kick-drift-kick leapfrog with hierarchical (block) time steps. Every body
+// steps by delta * 2^span / 2^level, with its level chosen from its
+// acceleration and the width of its tree leaf: dt = ETA * sqrt(width / |a|).
+// Bodies in quiet regions step by up to delta * 2^span, so they need fewer
+// force evaluations than with a global step of delta; delta is only the
+// output cadence. Each delta is split into 2^levels ticks; all bodies drift
+// every tick, so positions are current after every step, while only bodies
+// whose step ends on a tick get new forces and are kicked. A body whose step
+// spans the end of a delta carries its mid-step velocity across it.
+// Accelerations are replaced, not accumulated, by each force evaluation.
+class BlockIntegrator {
+
+private:
+    Particles &particles;
+    LinearOctTree &tree;
+    int span;                 // level 0 steps by delta * 2^span (SPAN overrides default)
+    int levels;               // ticks per delta are 2^levels (LEVELS overrides default)
+    int clock;                // tick within the current longest step
+    double eta;               // accuracy parameter (ETA overrides default)
+    bool started;             // initial forces evaluated
+    std::vector<int> level;   // time step level of each particle
+    std::vector<int> active;  // particles whose step ends on the current tick
+    bool rebuild;             // a particle left its leaf on the current tick
+
+    // Helper functions to evaluate forces and choose time step levels
+    void computeForces();
+    int chooseLevel(int i, double delta);
+
+public:
+    BlockIntegrator(Particles &particles, LinearOctTree &tree);
+
+    // Advance all particles by delta, continuing steps longer than delta from
+    // the last call. The tree is kept up to date with the particles' positions.
+    // Work is spread across all threads if parallel is set; called by every
+    // thread of an enclosing team, the team shares it instead.
+    void step(double delta, bool parallel);
+
+    // Store particles in the given order of particle indices, keeping levels.
+    // Shared by the team (Parallel.h).
+    void reorder(const std::vector<int> &order);
+
+    // Number of force evaluations in the last step
+    long forceEvaluations;
+
+};
+
+#endif // _BLOCKINTEGRATOR_DEFINED
@@ -12,6 +12,14 @@
 #include <tuple>
 #include <fstream>
 
+// Number of simulated dimensions, fixed at compile time (make DIM=2 builds a
+// planar simulation over a quadtree). Planar builds keep every z component at
+// zero and skip it in the trees and kernels.
+#ifndef DIMENSIONS
+#define DIMENSIONS 3
+#endif
+static_assert(DIMENSIONS == 2 || DIMENSIONS == 3, "DIMENSIONS must be 2 or 3");
+
 typedef std::tuple<double, double, double> vector_3d;
 
 constexpr int X = 0;  // for indexing the x value in a vector_3d
@@ -37,6 +45,7 @@ public:
     vector_3d pos;  // center of mass position vector: <x, y, z>
     vector_3d acc;  // acceleration vector: <a_x, a_y, a_z>
     vector_3d vel;  // velocity vector: <v_x, v_y, v_z>
+    double accMag;  // magnitude of the last applied acceleration
 
     Body();
     Body(int id, double mass, const vector_3d& pos);
@@ -92,6 +101,10 @@ inline Body getBody(std::ifstream& f) {
     f >> posx >> posy >> posz;
     f >> accx >> accy >> accz;
     f >> velx >> vely >> velz;
+    if (DIMENSIONS == 2) {
+        // planar simulation: project onto the x/y plane
+        posz = accz = velz = 0.0;
+    }
     // generate and return new body with parsed values
     vector_3d pos = std::make_tuple(posx, posy, posz);
     vector_3d acc = std::make_tuple(accx, accy, accz);
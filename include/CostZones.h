@@ -0,0 +1,52 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: CostZones.h
+ */
+
+#ifndef _COSTZONES_DEFINED
+#define _COSTZONES_DEFINED
+
+#include <vector>
+
+// Balances the per-particle force loop across threads. The cost of every
+// particle (the number of interactions of its tree walk) is recorded during a
+// step, and the next step splits particles in tree order into contiguous
+// zones of equal cost, one per thread. Neighbouring particles have similar
+// walks, so zones keep both the work balanced and each thread's walks local.
+// Interaction counts, unlike timings, are not disturbed by preemption or
+// other threads. BALANCE=static falls back to equal particle counts.
+class CostZones {
+
+private:
+    bool balanced;              // zones follow measured cost (BALANCE)
+    std::vector<double> cost;   // cost of each particle in the last step
+    std::vector<int> bounds;    // zone z covers positions [bounds[z], bounds[z + 1])
+    const std::vector<int> *order;  // particle index at each position, identity if null
+
+public:
+    CostZones(int numParticles);
+
+    // Split particles visited in the given order (particle indices, or
+    // index order if null) into numZones zones
+    void partition(const std::vector<int> *order, int numZones);
+
+    int numZones() const { return (int)bounds.size() - 1; }
+    int begin(int zone) const { return bounds[zone]; }
+    int end(int zone) const { return bounds[zone + 1]; }
+
+    // Particle index at position s of the partitioned order
+    int particle(int s) const { return order == nullptr ? s : (*order)[s]; }
+
+    // Record cost of particle i in this step
+    void record(int i, double work) { cost[i] = work; }
+
+    // Particles were stored in the given order of particle indices
+    void permute(const std::vector<int> &order);
+
+    // Forget recorded costs, e.g. after particles were reordered
+    void reset();
+
+};
+
+#endif // _COSTZONES_DEFINED
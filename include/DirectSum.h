@@ -0,0 +1,39 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: DirectSum.h
+ */
+
+#ifndef _DIRECTSUM_DEFINED
+#define _DIRECTSUM_DEFINED
+
+#include <vector>
+#include "Particles.h"
+
+constexpr int DIRECT_TILE = 512;  // bodies per tile, a pair of tiles stays in L2
+
+// Exact O(N^2) gravitational forces. Bodies are split into tiles and every
+// tile pair (I, J) with I <= J is evaluated once: each body pair acts on both
+// bodies, halving the interactions. Tile pairs are evaluated in rounds in
+// which no two pairs share a tile, spread across threads, so all threads add
+// into one set of accumulators without conflicts. The rounds do not depend on
+// the number of threads, so neither do the forces.
+class DirectSum {
+
+private:
+    Particles &particles;
+    aligned_vector accX, accY, accZ;  // acceleration (without G) of each body
+
+    // Helper function to evaluate every body pair of tiles a and b
+    void tilePair(int a, int b);
+
+public:
+    DirectSum(Particles &particles);
+
+    // Apply the total force on every particle, split across all threads if
+    // parallel is set
+    void forces(bool parallel);
+
+};
+
+#endif // _DIRECTSUM_DEFINED
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Domain.h
+ */
+
+#ifndef _DOMAIN_DEFINED
+#define _DOMAIN_DEFINED
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <mpi.h>
+#include "Body.h"
+#include "OctTree.h"
+
+// Decomposes bodies across MPI ranks along the Morton curve of the bounds of
+// all bodies. Every rank owns one contiguous range of the curve holding an
+// equal share of the total work, measured in interactions of the last step.
+// Ranks then exchange locally essential trees: each rank sends every other
+// rank the nodes (as point masses) and bodies of its own tree that bodies
+// within the other rank's bounding box interact with.
+class Domain {
+
+private:
+    int rank;
+    int numRanks;
+    vector_3d lowerBound;             // bounds of all bodies on all ranks
+    vector_3d upperBound;
+    std::vector<uint64_t> splitters;  // first curve key owned by each rank
+
+    // Helper functions to find the bounds of all bodies and choose splitters
+    void globalBounds(const std::vector<Body> &bodies);
+    void chooseSplitters(const std::vector<std::pair<uint64_t, int>> &keys,
+                         const std::vector<double> &work);
+
+public:
+    // Number of point masses imported in the last exchange
+    long imported;
+
+    Domain();
+
+    int getRank() const { return rank; }
+    int getNumRanks() const { return numRanks; }
+
+    // Move every body, with its work, to the rank owning its part of the curve
+    void decompose(std::vector<Body> &bodies, std::vector<double> &work);
+
+    // Exchange locally essential trees. tree holds this rank's bodies, and
+    // the point masses this rank needs from all other ranks are returned in
+    // masses as x, y, z, mass.
+    void exchange(OctTree &tree, const std::vector<Body> &bodies, std::vector<double> &masses);
+
+    // Gather the bodies of all ranks on rank 0, ordered by id, as binary
+    // trajectory frames need them
+    void gather(const std::vector<Body> &bodies, std::vector<Body> &all);
+
+};
+
+#endif // _DOMAIN_DEFINED
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: FastMultipole.h
+ */
+
+#ifndef _FASTMULTIPOLE_DEFINED
+#define _FASTMULTIPOLE_DEFINED
+
+#include <vector>
+#include "LinearOctTree.h"
+
+constexpr double DEFAULT_FMM_THETA = 0.7;  // cells interact when (r_a + r_b) / dist < theta
+constexpr int FMM_LEAF_BODIES = 16;        // cells with fewer bodies are summed directly, not split
+constexpr int FMM_TASK_BODIES = 512;       // target cells smaller than this are not split into tasks
+
+// Dual-tree (FMM style) solver over a LinearOctTree. Pairs of cells are
+// walked together from (root, root): well separated pairs add the source
+// cell's monopole to the target cell's local expansion (field and field
+// gradient about its center of mass), close pairs of leaves or small cells
+// are summed directly, and otherwise the larger cell is split. Local
+// expansions are then shifted down to the leaves and evaluated at every body.
+// The expansion order is fixed (monopole sources, first order local
+// expansions), so accuracy is set by theta alone.
+class FastMultipole {
+
+private:
+    LinearOctTree &tree;
+    double theta;  // separation parameter (FMM_THETA overrides default)
+
+    // Node data, indexed by node id
+    std::vector<double> radius;                 // max distance from center of mass to a body
+    std::vector<double> fieldX, fieldY, fieldZ; // local expansion: field at center of mass
+    std::vector<double> gradXX, gradXY, gradXZ; // local expansion: symmetric field gradient
+    std::vector<double> gradYY, gradYZ, gradZZ;
+
+    // Acceleration (without G) from direct summation, indexed by position in tree order
+    std::vector<double> accX, accY, accZ;
+
+    // Helper functions for the dual-tree walk
+    void nodeRadius(int node);
+    void setRadius();
+    void interact(int a, int b);
+    void cellCell(int a, int b);
+    void bodyBody(int a, int b);
+
+    // Helper functions to shift local expansions to the leaves and apply forces
+    void shiftDown(int node);
+    void passDown();
+
+public:
+    FastMultipole(LinearOctTree &tree);
+
+    // Apply force on every particle of the tree. The tree's center of mass
+    // must be up to date. Work is spread across all threads if parallel is set;
+    // called by every thread of an enclosing team, the team shares it instead.
+    void forces(bool parallel);
+
+};
+
+#endif // _FASTMULTIPOLE_DEFINED
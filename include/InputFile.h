@@ -0,0 +1,81 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: InputFile.h
+ */
+
+#ifndef _INPUTFILE_DEFINED
+#define _INPUTFILE_DEFINED
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Body.h"
+
+constexpr char INPUT_MAGIC[8] = {'B', 'H', 'I', 'N', 'P', 'U', 'T', '\0'};
+constexpr uint32_t INPUT_VERSION = 1;
+constexpr int INPUT_COLUMNS = 11;   // id, mass, x, y, z, ax, ay, az, vx, vy, vz
+constexpr size_t INPUT_ALIGN = 64;  // byte alignment of the header and every column
+
+// Header of a binary input file. It is followed by one column per body
+// field: int32 ids, then doubles for mass, position, acceleration and
+// velocity, each starting at a multiple of INPUT_ALIGN. Values are stored in
+// native (little-endian) byte order.
+struct InputHeader {
+    char magic[8];                    // INPUT_MAGIC
+    uint32_t version;                 // INPUT_VERSION
+    uint32_t reserved;
+    uint64_t count;                   // number of bodies
+    double lower[3];                  // simulation bounds
+    double upper[3];
+    uint64_t offsets[INPUT_COLUMNS];  // byte offset of each column in the file
+};
+
+// Particle input, read from either the text format (count, bounds, then one
+// body per line) or the binary format, which is told apart by its magic.
+// Binary files are memory mapped and their columns read in place, so bodies
+// can be constructed by all threads directly from the file.
+class InputFile {
+
+private:
+    bool opened;
+    int count;
+    vector_3d lowerBound;
+    vector_3d upperBound;
+    void *map;                         // mapping of a binary file
+    size_t mapLength;
+    const int32_t *ids;                // columns, mapped or owned
+    const double *columns[INPUT_COLUMNS - 1];
+    std::vector<int32_t> ownedIds;     // columns parsed from a text file
+    std::vector<double> owned[INPUT_COLUMNS - 1];
+
+    // Helper functions to read either format
+    bool readText(const char *path);
+    bool mapBinary(const char *path);
+
+public:
+    InputFile(const char *path);
+    ~InputFile();
+
+    InputFile(const InputFile &) = delete;
+    InputFile &operator=(const InputFile &) = delete;
+
+    // Whether the file was opened and read; errors are printed to std::cerr
+    bool is_open() const { return opened; }
+
+    int size() const { return count; }
+    vector_3d lower() const { return lowerBound; }
+    vector_3d upper() const { return upperBound; }
+
+    // Body i of the file, safe to call from many threads at once
+    Body body(int i) const;
+
+};
+
+// Write bodies and bounds as a binary input file, returning false (after
+// printing why to std::cerr) if the file could not be written
+bool writeBinaryInput(const char *path, const std::vector<Body> &bodies, const vector_3d &lower,
+                      const vector_3d &upper);
+
+#endif // _INPUTFILE_DEFINED
@@ -0,0 +1,41 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Kernels.h
+ */
+
+#ifndef _KERNELS_DEFINED
+#define _KERNELS_DEFINED
+
+// SIMD kernels over struct of arrays body data. The widest instruction set
+// supported by the CPU (AVX-512, AVX2 or scalar) is chosen at runtime, and
+// KERNEL=scalar|avx2|avx512 selects a narrower one.
+
+/* Accumulate into acc the acceleration (without G) at (px, py, pz) produced
+ * by n point masses: acc += sum of m * d / |d|^3. Point masses at zero
+ * distance are skipped. */
+void accumulateAccel(const double *x, const double *y, const double *z, const double *m,
+                     int n, double px, double py, double pz, double acc[3]);
+
+/* Single precision variant of accumulateAccel for mixed precision: every
+ * interaction is evaluated in float and their sum is accumulated in double */
+void accumulateAccel(const float *x, const float *y, const float *z, const float *m,
+                     int n, float px, float py, float pz, double acc[3]);
+
+/* Move bodies [begin, end) for t seconds given acceleration and velocity */
+void moveBodies(double *x, double *y, double *z, double *vx, double *vy, double *vz,
+                const double *ax, const double *ay, const double *az, int begin, int end,
+                double t);
+
+/* Accumulate into ax, ay, az (without G) the mutual accelerations of every
+ * pair of bodies i in [begin, end) and j in [sourceBegin, sourceEnd) with
+ * j > i. Each pair is evaluated once and acts on both bodies (Newton's third
+ * law); arrays are indexed by body. */
+void accumulatePairs(const double *x, const double *y, const double *z, const double *m,
+                     int begin, int end, int sourceBegin, int sourceEnd, double *ax,
+                     double *ay, double *az);
+
+/* Name of the selected kernels */
+const char *kernelName();
+
+#endif // _KERNELS_DEFINED
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: LinearOctTree.h
+ */
+
+#ifndef _LINEAROCTTREE_DEFINED
+#define _LINEAROCTTREE_DEFINED
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "OctTree.h"
+#include "Opening.h"
+#include "Particles.h"
+
+constexpr int MAX_DEPTH = 21;        // maximum depth of tree (21 bits per axis)
+constexpr int LEAF_BUCKET_SIZE = 8;  // default maximum bodies per leaf
+constexpr int GROUP_BODIES = 32;     // default maximum bodies sharing one group walk
+constexpr int LEVEL_NODES = 1024;    // narrower tree levels are summed by a single thread
+
+/* Morton (Z-order) key of pos on the 2^MAX_DEPTH grid spanning [lower, upper],
+ * interleaved as x, y, z per level to match octet numbering */
+uint64_t mortonKey(const vector_3d &pos, const vector_3d &lower, const vector_3d &upper);
+
+// Read-only view of the tree-ordered body arrays in one precision
+template <typename real>
+struct BodyArrays {
+    const real *x, *y, *z, *mass;
+};
+
+// Pointer-free OctTree stored as index-addressed arrays (struct of arrays).
+// Node 0 is the root, children of a node are stored contiguously starting at
+// childBegin, and every node owns a contiguous range of bodies in tree order.
+// Bodies are ordered along the Morton (Z-order) curve of the root bounds and
+// nodes are stored level by level, so every child follows its parent. Leaves
+// are buckets of up to bucketSize bodies evaluated by direct summation.
+// Bodies are read from a struct of arrays particle container and all
+// interactions are evaluated by the SIMD kernels. With PRECISION=mixed,
+// interactions of the tree walks are evaluated in single precision, using
+// positions relative to the root's center and masses relative to the total
+// mass, while accelerations are still accumulated in double precision.
+class LinearOctTree {
+
+    // Dual-tree solver walks the node and body arrays directly
+    friend class FastMultipole;
+
+private:
+    Particles &particles;
+    vector_3d lowerBound;  // simulation bounds, grown to fit escaping bodies
+    vector_3d upperBound;
+    int bucketSize;  // maximum bodies per leaf (BUCKET_SIZE overrides default)
+    int groupSize;   // maximum bodies per group (GROUP_SIZE overrides default)
+    Opening opening; // node opening criterion (OPENING, THETA, ALPHA)
+    bool mixed;      // evaluate walk interactions in float (PRECISION=mixed)
+
+    // Node data, indexed by node id
+    aligned_vector mass;                    // total mass of bodies within node
+    aligned_vector comX, comY, comZ;        // center of mass of bodies within node
+    aligned_vector size;                    // width of node bounds
+    aligned_vector bmax;                    // largest distance from center of mass to bounds
+    aligned_vector lowerX, lowerY, lowerZ;  // lower bound of node
+    aligned_vector upperX, upperY, upperZ;  // upper bound of node
+    aligned_array<int> childBegin;          // index of first child node
+    aligned_array<int> childCount;          // number of children nodes (0 for leaf)
+    aligned_array<int> bodyBegin;           // index of first body in tree order
+    aligned_array<int> bodyCount;           // number of bodies within node
+    std::vector<int> levels;                // first node of each level, then numNodes()
+    std::vector<int> offsets;               // first child of each node of the level being built
+    vector_3d fitLower, fitUpper;           // root bounds being merged by the team in build
+
+    // Body data, indexed by position in tree order
+    std::vector<std::pair<uint64_t, int>> keys;     // sorted Morton key and particle index
+    std::vector<int> order;                          // particle index of body
+    aligned_vector bodyX, bodyY, bodyZ, bodyMass;
+
+    // Single precision body data for mixed precision, relative to origin and massUnit
+    aligned_array<float> mixedX, mixedY, mixedZ, mixedMass;
+    double originX, originY, originZ;  // 0 in double precision
+    double massUnit;                   // 1 in double precision
+
+    // Leaf node holding each particle, indexed by particle index
+    std::vector<int> leafOf;
+
+    // Largest nodes holding at most groupSize bodies, covering every body once
+    std::vector<int> groups;
+
+    // Helper functions to construct tree
+    void setNode(int node, double lx, double ly, double lz, double ux, double uy,
+                 double uz, int begin, int count);
+    void resizeNodes(int n);
+    uint64_t mortonKey(double x, double y, double z);
+    void octetRanges(int node, int depth, int bounds[OCT_REGIONS + 1]);
+    void collectGroups();
+
+    // Helper functions to select body arrays of the kernels' precision
+    void bodyArrays(BodyArrays<double> &arrays) const;
+    void bodyArrays(BodyArrays<float> &arrays) const;
+
+    // Helper functions to walk the tree for one particle or one group with
+    // interactions evaluated in real precision
+    template <typename real> vector_3d walkForce(int i, int *interactions);
+    template <typename real> void walkGroup(int group);
+
+    // Helper function to apply force on every body of group using one walk
+    void groupForce(int group);
+
+public:
+    LinearOctTree(Particles &particles, vector_3d lowerBound,
+                  vector_3d upperBound);
+
+    // Rebuild tree from current particle positions by sorting Morton keys
+    // and emitting one level at a time in parallel. The root covers the
+    // simulation bounds plus the bounding box of every body. Inside a parallel
+    // region every thread of the team calls this (see Parallel.h).
+    void build();
+
+    // Number of nodes in the tree
+    int numNodes() const { return (int)mass.size(); }
+
+    // Set center of mass for each node, shared by the team like build, and
+    // its helper for one node
+    void setCenterOfMass();
+    void centerOfMass(int node);
+
+    // Helper function to calculate force on particle i using tree. The number
+    // of bodies and nodes interacting with particle i is added to interactions.
+    vector_3d treeForce(int i, int *interactions = nullptr);
+
+    // Apply force on every particle, walking the tree once per group of
+    // nearby bodies and evaluating the shared interaction list against each
+    // member. Groups are spread across all threads if parallel is set, or
+    // across the team when called by every thread of a parallel region.
+    void groupForces(bool parallel);
+
+    // Number of groups walked by groupForces
+    int numGroups() const { return (int)groups.size(); }
+
+    // Width of the leaf holding particle i
+    double leafSize(int i) const { return size[leafOf[i]]; }
+
+    // Helper function to check if particle i has moved out of its leaf's bounds
+    bool checkParticleBounds(int i);
+
+    // Particle indices in tree (Morton) order
+    const std::vector<int> &treeOrder() const { return order; }
+
+    // Helper functions to print Tree
+    void print();
+    void printRecurse(int node);
+
+};
+
+#endif // _LINEAROCTTREE_DEFINED
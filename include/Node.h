@@ -9,7 +9,15 @@
 
 #include "Body.h"
 
-constexpr int OCT_REGIONS = 8;
+constexpr int OCT_REGIONS = 1 << DIMENSIONS;  // children per node (4 in a planar quadtree)
+
+// Components of a symmetric 3x3 tensor stored as 6 values
+constexpr int XX = 0;
+constexpr int XY = 1;
+constexpr int XZ = 2;
+constexpr int YY = 3;
+constexpr int YZ = 4;
+constexpr int ZZ = 5;
 
 /* calculate average of 2 vectors */
 inline vector_3d average(const vector_3d &lowerBound, const vector_3d &upperBound) {
@@ -34,7 +42,7 @@ public:
 
 };
 
-/* OctTree root node */
+/* OctTree root node, allocated from a NodeArena */
 class Root : public Node {
 
 public:
@@ -42,13 +50,14 @@ public:
     vector_3d lowerBound;    // lower bound of section
     vector_3d upperBound;    // upper bound of section
     double size;             // width region bounds
+    double bmax;             // largest distance from center of mass to the bounds
     double mass;             // total mass of bodies within section
     vector_3d centerOfMass;  // center of mass position of all bodies within section
+    double quadrupole[6];    // traceless quadrupole moment about center of mass
     int numChildren;         // number of children nodes
-    Node **children;         // children nodes (leaves and/or internal roots)
+    Node *children[OCT_REGIONS];  // children nodes (leaves and/or internal roots)
 
     Root(Node *parent, vector_3d lowerBound, vector_3d upperBound);
-    ~Root();
 
     /* Override "<<" operator for printing Root details to I/O output stream */
     friend std::ostream& operator<<(std::ostream& out, const Root& r);
@@ -62,7 +71,9 @@ public:
 class Leaf : public Node {
 
 public:
-    Body body;  // physical body representation
+    Body body;      // physical body representation
+    bool overflow;  // placed past MAX_TREE_DEPTH in an octet that does not contain it
+    int index;      // position in the particles vector, if the driver tracks it (else -1)
 
     Leaf(Node *parent, Body &&body);
 
@@ -81,6 +92,9 @@ public:
     /* Calculate force vector produced on this by root's mass and center of mass values */
     vector_3d rootForce(Root *root, double dist);
 
+    /* Calculate force vector produced on this by root's quadrupole moment */
+    vector_3d rootQuadrupoleForce(Root *root, double dist);
+
 };
 
 #endif // _NODE_DEFINED
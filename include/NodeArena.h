@@ -0,0 +1,57 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: NodeArena.h
+ */
+
+#ifndef _NODEARENA_DEFINED
+#define _NODEARENA_DEFINED
+
+#include <cstddef>
+#include <vector>
+#include "Node.h"
+#include "Particles.h"
+
+constexpr int ARENA_CHUNK_NODES = 1024;  // Root nodes per arena chunk
+
+// Chunked pool allocator for OctTree Root nodes. The arena is split into
+// pools so that threads building disjoint subtrees never share a pool. Freed
+// nodes are recycled through a per-pool free list, and reset() releases every
+// node at once while keeping the chunks for the next tree.
+class NodeArena {
+
+private:
+    // Pools start on separate cache lines, also in the aligned pool array
+    struct alignas(64) Pool {
+        std::vector<Root *> chunks;    // storage for ARENA_CHUNK_NODES Roots each
+        std::vector<Root *> freeList;  // recycled nodes
+        int chunk;                     // index of chunk currently handed out
+        int used;                      // nodes handed out from current chunk
+        long long inUse;               // nodes allocated and not yet freed
+    };
+    aligned_array<Pool> pools;
+
+public:
+    NodeArena(int numPools);
+    ~NodeArena();
+
+    // The arena owns its chunks, so it is never copied
+    NodeArena(const NodeArena &) = delete;
+    NodeArena &operator=(const NodeArena &) = delete;
+
+    // Allocate and construct a Root node from pool
+    Root *allocRoot(int pool, Node *parent, vector_3d lowerBound, vector_3d upperBound);
+
+    // Return a Root node to pool for reuse
+    void freeRoot(int pool, Root *root);
+
+    // Release every node in the arena without returning chunks to the system
+    void reset();
+
+    // Memory footprint of the arena
+    long long nodesInUse();
+    size_t bytesReserved();
+
+};
+
+#endif // _NODEARENA_DEFINED
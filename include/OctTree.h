@@ -8,9 +8,24 @@
 #define _OCTTREE_DEFINED
 
 #include <vector>
+#include <omp.h>
 #include "Node.h"
+#include "NodeArena.h"
+#include "Opening.h"
 
-constexpr double THETA = 0.9;  // Barnes-Hut Parameter
+constexpr int SERIAL_POOL = OCT_REGIONS;  // arena pool for serial updates
+constexpr int MAX_TREE_DEPTH = 48;        // depth past which cells are only split when full
+constexpr int COM_TASKS_PER_THREAD = 8;   // center of mass subtrees spawned as tasks per thread
+
+/* Arena pools: one per octet, one for serial updates, and one per OpenMP thread */
+inline int arenaPools() {
+    return SERIAL_POOL + 1 + omp_get_max_threads();
+}
+
+/* Arena pool owned by the calling OpenMP thread */
+inline int threadPool() {
+    return SERIAL_POOL + 1 + omp_get_thread_num();
+}
 
 // Data structure representing OctTree for Barnes-Hut Simulation
 class OctTree {
@@ -18,37 +33,90 @@ class OctTree {
 private:
     Root *root;
     bool parallel;
+    bool quadrupole;  // QUADRUPOLE adds quadrupole moments to node forces
+    Opening opening;  // node opening criterion (OPENING, THETA, ALPHA)
+    NodeArena *arena;
+    bool ownsArena;
+    vector_3d lowerBound;  // initial bounds, restored on rebuild
+    vector_3d upperBound;
+    vector_3d fitLower;    // bounds of the particles being fit, merged by each thread
+    vector_3d fitUpper;
+    std::vector<int> octetIndices[OCT_REGIONS];  // leaf indices of each top-level octet (treeIndex)
+    std::vector<double> octetMasses[OCT_REGIONS];  // point masses of each top-level octet (essentialBodies)
 
 public:
+    // Root nodes are allocated from arena, which must be reset by the caller
+    // once the tree is destroyed. Without an arena the tree owns its own.
     OctTree(std::vector<Leaf *> &particles, vector_3d lowerBound,
-            vector_3d upperBound);
+            vector_3d upperBound, NodeArena *arena = nullptr);
     ~OctTree();
 
+    // Rebuild tree from scratch, releasing every Root node in the arena.
+    // rebuild, insertParticles, reinsertParticles and setCenterOfMass are
+    // shared by the team when called inside a parallel region (Parallel.h).
+    void rebuild(std::vector<Leaf *> &particles);
+
     // Helper functions to insert particles into Tree
     void insert(Leaf *particle);
-    void insertParticle(Root *root, Leaf *particle, const int octet);
+    void insertParticle(Root *root, Leaf *particle, const int octet, const int pool);
     void insertParticles(std::vector<Leaf *> &particles);
 
     // Helper function to find octet to insert particle into
     int findOctet(const vector_3d &rootPos, const vector_3d &bodyPos);
 
+    // Helper functions to grow the root by doubling until it contains bodies
+    // that left the simulation bounds, keeping the tree depth bounded
+    void growRoot(const vector_3d &pos);
+    void growRootToFit(std::vector<Leaf *> &particles);
+
     // Helper function to remove Leaf from tree and rebalance tree
     void remove(Leaf *particle);
 
     // Helper function to maybe replace Root node with Leaf node
     void maybeReplaceRoot(Root *root);
 
-    // Helper functions to set center of mass for each Root node
-    void setCenterOfMass();
-    void centerOfMass(Root *root);
+    // Helper functions to remove and re-insert moved particles concurrently.
+    // Child slots are claimed with compare-and-swap, and Root nodes left empty
+    // or holding a single Leaf are only reclaimed once all threads are done.
+    void reinsertParticles(std::vector<Leaf *> &moved);
+    void insertConcurrent(Leaf *particle);
+    void prune(Root *root);
 
-    // Helper functions to calculate force on particle using tree
-    vector_3d treeForce(Leaf *particle);
-    vector_3d partialTreeForce(Leaf *particle, Node *node);
+    // Helper functions to set center of mass for each Root node. Only Root
+    // nodes within the top taskLevels levels spawn tasks for their children;
+    // deeper subtrees are summed serially by the task that reaches them.
+    void setCenterOfMass();
+    void centerOfMass(Root *root, int taskLevels);
+
+    // Helper functions to calculate force on particle using tree. The number
+    // of bodies and nodes interacting with particle is added to interactions.
+    vector_3d treeForce(Leaf *particle, int *interactions = nullptr);
+    vector_3d partialTreeForce(Leaf *particle, Node *node, int *interactions = nullptr);
+
+    // Helper functions to list the point masses that bodies anywhere within
+    // [lower, upper] interact with: Root nodes accepted for all such bodies as
+    // their mass at their center of mass, and the bodies of leaves otherwise.
+    // Each is appended to masses as x, y, z, mass, and essentialNode returns
+    // whether node must be opened instead. Uses orphaned worksharing (Parallel.h).
+    void essentialBodies(const vector_3d &lower, const vector_3d &upper,
+                         std::vector<double> &masses);
+    bool essentialNode(Node *node, const vector_3d &lower, const vector_3d &upper,
+                       std::vector<double> &masses);
+    void essentialRecurse(Node *node, const vector_3d &lower, const vector_3d &upper,
+                          std::vector<double> &masses);
 
     // Helper function to check if a particle has moved out of its root's bounds
     bool checkParticleBounds(Leaf *particle);
 
+    // Helper functions to list particles in depth-first tree order
+    void treeOrder(std::vector<Leaf *> &ordered);
+    void treeOrderRecurse(Root *root, std::vector<Leaf *> &ordered);
+
+    // List Leaf::index of every particle in depth-first tree order, with one
+    // task per top-level octet. Shared by the team (Parallel.h).
+    void treeIndex(std::vector<int> &order);
+    void treeIndexRecurse(Root *root, std::vector<int> &order);
+
     // Helper functions to print Tree
     void print();
     void printRecurse(Root *root);
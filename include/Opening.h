@@ -0,0 +1,61 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Opening.h
+ */
+
+#ifndef _OPENING_DEFINED
+#define _OPENING_DEFINED
+
+#include "Body.h"
+
+constexpr double DEFAULT_THETA = 0.9;    // Barnes-Hut Parameter
+constexpr double DEFAULT_ALPHA = 0.001;  // relative force error of RELATIVE criterion
+
+/* Read a positive parameter from the environment, or return fallback */
+double positiveEnv(const char *name, double fallback);
+
+enum OpeningCriterion {GEOMETRIC, BMAX, RELATIVE};
+
+// Decides whether a tree node is far enough from a body to act as a single
+// interaction, or must be opened. Selected at runtime:
+//  OPENING=geometric - size / dist < THETA (classic Barnes-Hut)
+//  OPENING=bmax      - bmax / dist < THETA, where bmax is the largest distance
+//                      from the center of mass to the node's bounds (Salmon-Warren)
+//  OPENING=relative  - G * mass * size^2 / dist^4 < ALPHA * |a_old|, using the
+//                      body's acceleration of the previous step (GADGET-2).
+//                      Nodes containing the body are always opened, and bodies
+//                      without a previous acceleration use the geometric test.
+class Opening {
+
+public:
+    OpeningCriterion criterion;
+    double theta;  // opening angle (THETA)
+    double alpha;  // relative force error (ALPHA)
+
+    Opening();
+
+    /* Accept node given its mass, width and bmax, the squared distance from the
+     * body to its center of mass, the body's previous acceleration magnitude,
+     * and whether the body lies within the node's bounds */
+    bool accept(double mass, double size, double bmax, double distSq, double accOld,
+                bool contains) const {
+        switch (this->criterion) {
+        case BMAX:
+            return bmax * bmax < this->theta * this->theta * distSq;
+        case RELATIVE:
+            if (contains) {
+                return false;
+            }
+            if (accOld > 0) {
+                return G * mass * size * size < this->alpha * accOld * distSq * distSq;
+            }
+            return size * size < this->theta * this->theta * distSq;
+        default:
+            return size * size < this->theta * this->theta * distSq;
+        }
+    }
+
+};
+
+#endif // _OPENING_DEFINED
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Parallel.h
+ */
+
+#ifndef _PARALLEL_DEFINED
+#define _PARALLEL_DEFINED
+
+#include <algorithm>
+#include <vector>
+#include <omp.h>
+
+constexpr int SORT_CUTOFF = 8192;  // ranges smaller than this are sorted serially
+
+/* Functions below, and the tree updates built on them, use orphaned worksharing:
+ * inside a parallel region they must be called by every thread of the team,
+ * which then shares the work. Called outside any parallel region, they start a
+ * team of all threads for themselves. */
+inline bool outsideParallel() {
+    return omp_get_level() == 0;
+}
+
+/* Merge sort range [begin, end) of v using OpenMP tasks */
+template <typename T>
+void parallelSortRange(std::vector<T> &v, int begin, int end) {
+    if (end - begin < SORT_CUTOFF) {
+        std::sort(v.begin() + begin, v.begin() + end);
+        return;
+    }
+    int mid = begin + (end - begin) / 2;
+    #pragma omp task shared(v)
+    parallelSortRange(v, begin, mid);
+    parallelSortRange(v, mid, end);
+    #pragma omp taskwait
+    std::inplace_merge(v.begin() + begin, v.begin() + mid, v.begin() + end);
+}
+
+/* Sort v using all threads of the team */
+template <typename T>
+void parallelSort(std::vector<T> &v) {
+    if (outsideParallel()) {
+        #pragma omp parallel
+        parallelSort(v);
+        return;
+    }
+    #pragma omp single
+    parallelSortRange(v, 0, (int)v.size());
+}
+
+/* Replace v with its exclusive prefix sum using all threads of the team, return total */
+inline int parallelExclusiveScan(std::vector<int> &v) {
+    if (outsideParallel()) {
+        int total = 0;
+        #pragma omp parallel
+        {
+            int sum = parallelExclusiveScan(v);
+            #pragma omp master
+            total = sum;
+        }
+        return total;
+    }
+
+    // Each thread scans a contiguous chunk, then offsets it by the chunks before it
+    int n = (int)v.size();
+    int t = omp_get_thread_num();
+    int numThreads = omp_get_num_threads();
+    std::vector<int> *partial;
+    #pragma omp single copyprivate(partial)
+    partial = new std::vector<int>(numThreads + 1, 0);
+    int chunk = (n + numThreads - 1) / numThreads;
+    int begin = std::min(n, t * chunk);
+    int end = std::min(n, begin + chunk);
+    int sum = 0;
+    for (int i = begin; i < end; i++) {
+        int value = v[i];
+        v[i] = sum;
+        sum += value;
+    }
+    (*partial)[t + 1] = sum;
+    #pragma omp barrier
+    #pragma omp single
+    for (int i = 1; i <= numThreads; i++) {
+        (*partial)[i] += (*partial)[i - 1];
+    }
+    for (int i = begin; i < end; i++) {
+        v[i] += (*partial)[t];
+    }
+    int total = (*partial)[numThreads];
+    #pragma omp barrier
+    #pragma omp single nowait
+    delete partial;
+    return total;
+}
+
+/* Replace values with values[order[s]] for every position s, using all
+ * threads of the team */
+template <typename V>
+void parallelGather(V &values, const std::vector<int> &order) {
+    if (outsideParallel()) {
+        #pragma omp parallel
+        parallelGather(values, order);
+        return;
+    }
+    V *ordered;
+    #pragma omp single copyprivate(ordered)
+    ordered = new V(values.size());
+    #pragma omp for
+    for (int s = 0; s < (int)order.size(); s++) {
+        (*ordered)[s] = values[order[s]];
+    }
+    #pragma omp single
+    {
+        values.swap(*ordered);
+        delete ordered;
+    }
+}
+
+#endif // _PARALLEL_DEFINED
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Particles.h
+ */
+
+#ifndef _PARTICLES_DEFINED
+#define _PARTICLES_DEFINED
+
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <utility>
+#include <vector>
+#include "Node.h"
+#include "Parallel.h"
+
+constexpr size_t SIMD_ALIGN = 64;  // byte alignment of particle arrays (one AVX-512 vector)
+
+/* Allocator returning SIMD_ALIGN aligned memory */
+template <typename T>
+struct AlignedAllocator {
+    typedef T value_type;
+
+    AlignedAllocator() {}
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        void *p = nullptr;
+        if (posix_memalign(&p, SIMD_ALIGN, n * sizeof(T)) != 0) {
+            throw std::bad_alloc();
+        }
+        return (T *)p;
+    }
+    void deallocate(T *p, size_t) {
+        free(p);
+    }
+
+    // Elements are default-initialized, so resizing does not write new
+    // memory. Its pages are placed by whichever thread writes them first.
+    template <typename U>
+    void construct(U *p) {
+        ::new ((void *)p) U;
+    }
+    template <typename U, typename... Args>
+    void construct(U *p, Args &&... args) {
+        ::new ((void *)p) U(std::forward<Args>(args)...);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const AlignedAllocator<T> &, const AlignedAllocator<U> &) { return true; }
+template <typename T, typename U>
+bool operator!=(const AlignedAllocator<T> &, const AlignedAllocator<U> &) { return false; }
+
+template <typename T>
+using aligned_array = std::vector<T, AlignedAllocator<T>>;
+typedef aligned_array<double> aligned_vector;
+
+/* Reserve room for at least n values. New storage is first touched by all
+ * threads of the team in static blocks, spreading its pages over the
+ * threads' NUMA nodes. */
+template <typename T>
+void reserveParallel(aligned_array<T> &values, size_t n) {
+    if (values.capacity() >= n) {
+        return;
+    }
+    if (outsideParallel()) {
+        #pragma omp parallel
+        reserveParallel(values, n);
+        return;
+    }
+    long size = (long)values.size();
+    aligned_array<T> *grown;
+    #pragma omp single copyprivate(grown)
+    grown = new aligned_array<T>(n);
+    #pragma omp for schedule(static)
+    for (long k = 0; k < (long)n; k++) {
+        (*grown)[k] = k < size ? values[k] : T();
+    }
+    #pragma omp single
+    {
+        grown->resize(size);
+        values.swap(*grown);
+        delete grown;
+    }
+}
+
+// Bodies stored as a struct of aligned arrays, indexed by particle index, so
+// that force and movement kernels load consecutive bodies in SIMD registers.
+class Particles {
+
+public:
+    std::vector<int> id;
+    aligned_vector mass;
+    aligned_vector x, y, z;     // position
+    aligned_vector vx, vy, vz;  // velocity
+    aligned_vector ax, ay, az;  // acceleration
+    aligned_vector accMag;      // magnitude of the last applied acceleration
+
+    /* Copy bodies out of the given leaves */
+    Particles(const std::vector<Leaf *> &leaves);
+
+    int size() const { return (int)id.size(); }
+
+    /* Apply force vector on particle i by updating acceleration vector */
+    void apply(int i, const vector_3d &f) {
+        ax[i] += std::get<X>(f) / mass[i];
+        ay[i] += std::get<Y>(f) / mass[i];
+        az[i] += std::get<Z>(f) / mass[i];
+        accMag[i] = sqrt(std::get<X>(f) * std::get<X>(f) + std::get<Y>(f) * std::get<Y>(f) +
+                         std::get<Z>(f) * std::get<Z>(f)) / mass[i];
+    }
+
+    /* Simulate movement of all particles for t seconds, split across all
+     * threads if parallel is set; called by every thread of an enclosing
+     * team, the team shares it instead (Parallel.h) */
+    void move(double t, bool parallel);
+
+    /* Simulate movement of particle i for t seconds */
+    void moveParticle(int i, double t);
+
+    /* Store particles in the given order of particle indices. Ids are kept,
+     * so output still identifies every body. Shared by the team (Parallel.h). */
+    void permute(const std::vector<int> &order);
+
+    /* Log particle i to a file in the same format as Body::logBody */
+    void logBody(int i, std::ofstream &f) const;
+
+};
+
+#endif // _PARTICLES_DEFINED
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Reorder.h
+ */
+
+#ifndef _REORDER_DEFINED
+#define _REORDER_DEFINED
+
+#include <vector>
+#include "Node.h"
+
+/* Read reordering interval in time steps from REORDER (0 disables reordering) */
+int reorderInterval();
+
+/* Contiguous block of Leaf objects made by reorderParticles. The block is
+ * allocated uninitialized, so each leaf is first touched by the thread that
+ * constructs it. It owns its leaves and is never copied. */
+class LeafStorage {
+
+public:
+    Leaf *leaves;  // first leaf of the block, or nullptr before the first reorder
+    int count;     // leaves constructed in the block
+
+    LeafStorage() : leaves(nullptr), count(0) {}
+    ~LeafStorage() { release(); }
+
+    LeafStorage(const LeafStorage &) = delete;
+    LeafStorage &operator=(const LeafStorage &) = delete;
+
+    // Destroy every leaf and free the block
+    void release();
+
+};
+
+/* Store particles in the given (tree) order. Leaf objects are copied into one
+ * contiguous block held by storage, so that particles near each other in the
+ * tree are also near each other in memory. Each leaf is constructed in the
+ * static blocks of the force loop, which places it near the thread that walks
+ * it. Particles must either point into storage or, before the first reorder,
+ * be individually allocated with new. Body ids are kept, so output still
+ * identifies every body, and Leaf::index is set to the new position. Any tree built over particles must be rebuilt
+ * afterwards. Shared by the team (Parallel.h). */
+void reorderParticles(std::vector<Leaf *> &particles, const std::vector<Leaf *> &ordered,
+                      LeafStorage &storage);
+
+#endif // _REORDER_DEFINED
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: SnapshotWriter.h
+ */
+
+#ifndef _SNAPSHOTWRITER_DEFINED
+#define _SNAPSHOTWRITER_DEFINED
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Body.h"
+#include "Node.h"
+#include "Particles.h"
+#include "Trajectory.h"
+
+constexpr size_t SNAPSHOT_CHUNK = 1 << 20;  // bytes of formatted text per write
+
+// Layout of the values of each body in a snapshot, filled by packValues
+constexpr int SNAPSHOT_MASS = 0;     // mass
+constexpr int SNAPSHOT_POS = 1;      // x, y, z
+constexpr int SNAPSHOT_ACC = 4;      // ax, ay, az
+constexpr int SNAPSHOT_VEL = 7;      // vx, vy, vz
+constexpr int SNAPSHOT_VALUES = 10;  // doubles per body
+
+// Writes logged time steps from a background thread, as text in the format
+// of Body::logBody prefixed by the time step, and/or as frames of a binary
+// Trajectory. Bodies of a step are copied into one of two snapshot buffers,
+// so the simulation carries on while the other buffer is formatted and
+// written. Memory is bounded by the two buffers: queueing a step waits while
+// both still hold unwritten steps.
+class SnapshotWriter {
+
+private:
+    struct Snapshot {
+        int step;
+        std::vector<int> id;
+        std::vector<double> values;  // mass, position, acceleration, velocity of each body
+    };
+
+    std::ofstream *out;      // text output, or nullptr
+    Trajectory *trajectory;  // binary output, or nullptr
+    Snapshot buffers[2];
+    bool full[2];  // buffer holds a step that is not written yet
+    int next;      // buffer the next step is copied into
+    int current;   // buffer the writer thread writes next
+    bool done;     // no more steps will be queued
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread thread;
+
+    // Helper functions to hand buffers between the simulation and the writer
+    Snapshot &acquire(int step, int n);
+    void submit();
+    void run();
+
+public:
+    // Steps are written to out and trajectory, either of which may be
+    // nullptr. Neither may be written to otherwise while steps are queued.
+    SnapshotWriter(std::ofstream *out, Trajectory *trajectory);
+    ~SnapshotWriter();
+
+    // Queue the bodies of a time step to be written. Inside a parallel region
+    // every thread of the team calls this and shares the copy (Parallel.h).
+    void write(int step, const std::vector<Leaf *> &particles);
+    void write(int step, const Particles &particles);
+    void write(int step, const std::vector<Body> &bodies);
+
+    // Wait until every queued step is written
+    void flush();
+
+};
+
+// Append the text log line of body at step to text, formatted as SnapshotWriter
+// writes it
+void appendLogLine(std::string &text, int step, const Body &body);
+
+#endif // _SNAPSHOTWRITER_DEFINED
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Trajectory.h
+ */
+
+#ifndef _TRAJECTORY_DEFINED
+#define _TRAJECTORY_DEFINED
+
+#include <cstdint>
+#include <fstream>
+#include <vector>
+#include "Body.h"
+
+constexpr char TRAJECTORY_MAGIC[8] = {'B', 'H', 'T', 'R', 'A', 'J', '\0', '\0'};
+constexpr char TRAJECTORY_INDEX_MAGIC[8] = {'B', 'H', 'T', 'I', 'N', 'D', 'E', 'X'};
+constexpr uint32_t TRAJECTORY_VERSION = 1;
+constexpr int DEFAULT_KEYFRAME = 32;  // frames between quantized key frames
+
+// Fields written for every body of a frame, selected by FIELDS
+constexpr uint32_t FIELD_POS = 1;
+constexpr uint32_t FIELD_VEL = 2;
+constexpr uint32_t FIELD_ACC = 4;
+constexpr uint32_t FIELD_MASS = 8;
+
+// Encodings of the positions of a frame
+constexpr uint32_t FRAME_RAW = 0;    // doubles
+constexpr uint32_t FRAME_KEY = 1;    // zigzag varints of grid coordinates
+constexpr uint32_t FRAME_DELTA = 2;  // zigzag varints of the change since the last frame
+
+// Header at the start of a trajectory file, followed by the int32 ids of
+// all bodies in ascending order, which is the order of bodies in every frame
+struct TrajectoryHeader {
+    char magic[8];       // TRAJECTORY_MAGIC
+    uint32_t version;    // TRAJECTORY_VERSION
+    uint32_t fields;     // FIELD_* bits
+    uint64_t count;      // number of bodies
+    uint32_t keyframe;   // frames between key frames
+    uint32_t reserved;
+    double quantum;      // grid spacing of quantized positions, 0 for raw positions
+    double origin[3];    // grid origin
+};
+
+// Header of each frame. Its payload holds the selected fields as columns of
+// doubles (all x, then all y, then all z): vel, acc and mass, then pos.
+// Frames are padded to a multiple of 8 bytes.
+struct FrameHeader {
+    int32_t step;
+    uint32_t encoding;   // FRAME_* encoding of the positions
+    uint64_t posBytes;   // bytes of encoded positions
+    uint64_t bytes;      // bytes of payload and padding following this header
+};
+
+// Trailer at the end of a complete trajectory file, after the byte offset of
+// every frame. Files cut short have no trailer and are read frame by frame.
+struct TrajectoryTrailer {
+    uint64_t indexOffset;
+    uint64_t frames;
+    char magic[8];       // TRAJECTORY_INDEX_MAGIC
+};
+
+// Binary trajectory of logged time steps. Positions are written as doubles,
+// or with QUANTIZE=q rounded to a grid of spacing q (error at most q/2),
+// every KEYFRAME-th frame absolutely and others as the change since the
+// previous frame, which is small from one step to the next.
+class Trajectory {
+
+private:
+    std::ofstream out;
+    uint32_t fields;
+    uint32_t keyframe;
+    double quantum;
+    vector_3d origin;
+    bool started;                  // header and ids written
+    uint64_t count;
+    std::vector<int> ids;          // ascending ids of the header
+    std::vector<int> order;        // snapshot index of each body in id order
+    std::vector<int64_t> grid;     // grid coordinates of the last frame, all x, y, z
+    bool quantized;                // the last frame was quantized
+    std::vector<uint64_t> offsets; // byte offset of every frame
+    uint64_t written;              // bytes written so far
+    std::vector<char> payload;
+
+    // Helper functions to encode one frame
+    void start(const int *id, int n);
+    void sortBodies(const int *id, int n);
+    uint32_t encodePositions(const double *values, int n);
+
+public:
+    // Positions are quantized relative to origin; check is_open afterwards
+    Trajectory(const char *path, const vector_3d &origin);
+
+    // Write the frame index and trailer
+    ~Trajectory();
+
+    bool is_open() const { return out.is_open(); }
+
+    // Write one frame from n bodies with values laid out as in SnapshotWriter
+    void writeFrame(int step, const int *id, const double *values, int n);
+
+};
+
+// Open the trajectory file named by TRAJECTORY, or return nullptr when it is
+// not set or cannot be opened
+Trajectory *openTrajectory(const vector_3d &origin);
+
+#endif // _TRAJECTORY_DEFINED
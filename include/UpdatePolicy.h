@@ -0,0 +1,47 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: UpdatePolicy.h
+ */
+
+#ifndef _UPDATEPOLICY_DEFINED
+#define _UPDATEPOLICY_DEFINED
+
+constexpr int PROBE_INTERVAL = 16;  // steps between re-measuring the strategy not chosen
+constexpr double COST_DECAY = 0.75; // weight of past measurements in cost model
+
+enum UpdateStrategy { REBUILD, INCREMENTAL };
+
+// Chooses each time step between rebuilding the OctTree and incrementally
+// re-inserting particles that left their octet. Rebuild time is tracked as a
+// running average, and incremental time is fit as a linear function of the
+// number of moved particles. The UPDATE environment variable ("rebuild" or
+// "incremental") overrides the choice.
+class UpdatePolicy {
+
+private:
+    int forced;            // forced strategy, or -1 to choose by cost
+    double rebuildCost;    // average rebuild time in microseconds, < 0 if unknown
+    // Decayed sums for least-squares fit: time = fixed + perMoved * moved
+    double sumWeight, sumMoved, sumTime, sumMovedSq, sumMovedTime;
+    int sinceProbe;        // steps since the other strategy was last measured
+    UpdateStrategy last;   // strategy chosen in the previous step
+
+public:
+    int rebuilds;          // number of steps that rebuilt the tree
+    int incrementals;      // number of steps that updated the tree incrementally
+
+    UpdatePolicy();
+
+    // Predicted incremental update time for numMoved particles
+    double incrementalCost(int numMoved);
+
+    // Choose strategy for a step in which numMoved particles left their octet
+    UpdateStrategy choose(int numMoved);
+
+    // Record measured time of strategy for numMoved particles
+    void record(UpdateStrategy strategy, int numMoved, long long micros);
+
+};
+
+#endif // _UPDATEPOLICY_DEFINED
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Affinity.cpp
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include "Affinity.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+static cpu_set_t processCpus;  // CPUs the process could run on before pinThreads
+static bool pinned = false;
+
+/* CPUs the process may run on, in ascending order, saved in set */
+static std::vector<int> allowedCpus(cpu_set_t &set) {
+    std::vector<int> cpus;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return cpus;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+/* Integer stored in the sysfs file at path, or -1 if unknown */
+static int sysfsValue(const std::string &path) {
+    std::ifstream in(path);
+    int value;
+    return in >> value ? value : -1;
+}
+
+/* cpus grouped into physical cores in package and core order, each listing
+ * its SMT siblings in ascending order. A CPU of unknown topology is a core of
+ * its own. */
+static std::vector<std::vector<int>> cpuCores(const std::vector<int> &cpus) {
+    std::map<std::pair<int, int>, std::vector<int>> cores;
+    for (int cpu : cpus) {
+        std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        int package = sysfsValue(topology + "physical_package_id");
+        int core = sysfsValue(topology + "core_id");
+        if (package < 0 || core < 0) {
+            package = -1;
+            core = cpu;
+        }
+        cores[std::make_pair(package, core)].push_back(cpu);
+    }
+    std::vector<std::vector<int>> ordered;
+    for (auto &core : cores) {
+        ordered.push_back(core.second);
+    }
+    return ordered;
+}
+
+/* CPU of every thread of a team of numThreads, as described for pinThreads */
+static std::vector<int> threadCpus(const std::vector<std::vector<int>> &cores, int numThreads,
+        bool spread) {
+    // Hardware threads in the order threads take them
+    std::vector<int> order;
+    size_t numCpus = 0;
+    for (auto &core : cores) {
+        numCpus += core.size();
+    }
+    if (spread) {
+        for (size_t sibling = 0; order.size() < numCpus; sibling++) {
+            for (auto &core : cores) {
+                if (sibling < core.size()) {
+                    order.push_back(core[sibling]);
+                }
+            }
+        }
+    } else {
+        for (auto &core : cores) {
+            order.insert(order.end(), core.begin(), core.end());
+        }
+    }
+    int numCores = (int)cores.size();
+    std::vector<int> cpu(numThreads);
+    for (int t = 0; t < numThreads; t++) {
+        if (spread && numThreads < numCores) {
+            cpu[t] = cores[(long)t * numCores / numThreads][0];
+        } else {
+            cpu[t] = order[t % order.size()];
+        }
+    }
+    return cpu;
+}
+
+/* NUMA node of cpu from sysfs, or -1 if unknown */
+static int cpuNode(int cpu) {
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR *dir = opendir(path.c_str());
+    if (dir == NULL) {
+        return -1;
+    }
+    int node = -1;
+    while (struct dirent *entry = readdir(dir)) {
+        if (strncmp(entry->d_name, "node", 4) == 0) {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+#endif
+
+void
+pinThreads(int numThreads) {
+    char *pin = std::getenv("PIN");
+    if (pin == NULL || *pin == '\0') {
+        return;
+    }
+    bool spread = strcmp(pin, "spread") == 0;
+    if (!spread && strcmp(pin, "compact") != 0) {
+        std::cerr << "ignoring PIN=" << pin << " (expected compact or spread)" << std::endl;
+        return;
+    }
+    if (omp_get_proc_bind() != omp_proc_bind_false) {
+        std::cerr << "ignoring PIN=" << pin << " (OMP_PROC_BIND already binds threads)" <<
+            std::endl;
+        return;
+    }
+#ifdef __linux__
+    std::vector<int> cpus = allowedCpus(processCpus);
+    if (cpus.empty()) {
+        return;
+    }
+    std::vector<int> cpu = threadCpus(cpuCores(cpus), numThreads, spread);
+    pinned = true;
+    #pragma omp parallel num_threads(numThreads)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu[omp_get_thread_num()], &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#else
+    std::cerr << "ignoring PIN=" << pin << " (thread pinning needs Linux)" << std::endl;
+#endif
+}
+
+void
+unpinThread() {
+#ifdef __linux__
+    if (pinned) {
+        pthread_setaffinity_np(pthread_self(), sizeof(processCpus), &processCpus);
+    }
+#endif
+}
+
+void
+printPlacement(std::ostream &out, int numThreads) {
+    std::vector<int> cpu(numThreads, -1), node(numThreads, -1);
+#ifdef __linux__
+    #pragma omp parallel num_threads(numThreads)
+    {
+        int t = omp_get_thread_num();
+        cpu[t] = sched_getcpu();
+        node[t] = cpu[t] < 0 ? -1 : cpuNode(cpu[t]);
+    }
+#endif
+    out << "Threads: " << numThreads << std::endl;
+    out << "Thread CPUs:";
+    for (int t = 0; t < numThreads; t++) {
+        out << " " << cpu[t];
+    }
+    out << std::endl << "Thread Nodes:";
+    for (int t = 0; t < numThreads; t++) {
+        out << " " << node[t];
+    }
+    out << std::endl;
+}
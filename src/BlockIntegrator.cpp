@@ -0,0 +1,172 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: BlockIntegrator.cpp
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "BlockIntegrator.h"
+#include "Parallel.h"
+
+BlockIntegrator::BlockIntegrator(Particles &particles, LinearOctTree &tree) :
+        particles(particles), tree(tree) {
+    // Cache longest and shortest steps and accuracy parameter
+    char *span = std::getenv("SPAN");
+    this->span = span == NULL ? MAX_STEP_SPAN : std::max(0, std::min(10, atoi(span)));
+    char *levels = std::getenv("LEVELS");
+    this->levels = levels == NULL ? MAX_STEP_LEVELS : std::max(0, std::min(20, atoi(levels)));
+    char *eta = std::getenv("ETA");
+    this->eta = eta == NULL || atof(eta) <= 0 ? STEP_ETA : atof(eta);
+    this->started = false;
+    this->rebuild = false;
+    this->clock = 0;
+    this->level.assign(particles.size(), 0);
+    this->forceEvaluations = 0;
+}
+
+void
+BlockIntegrator::computeForces() {
+    int n = (int)active.size();
+    #pragma omp for schedule(dynamic, 64)
+    for (int k = 0; k < n; k++) {
+        int i = active[k];
+        vector_3d f = tree.treeForce(i);
+        double m = particles.mass[i];
+        particles.ax[i] = std::get<X>(f) / m;
+        particles.ay[i] = std::get<Y>(f) / m;
+        particles.az[i] = std::get<Z>(f) / m;
+        particles.accMag[i] = sqrt(particles.ax[i] * particles.ax[i] +
+                                   particles.ay[i] * particles.ay[i] +
+                                   particles.az[i] * particles.az[i]);
+    }
+    #pragma omp single
+    this->forceEvaluations += n;
+}
+
+int
+BlockIntegrator::chooseLevel(int i, double delta) {
+    double acc = particles.accMag[i];
+    if (acc <= 0) {
+        return 0;
+    }
+    // Shallowest level whose step does not exceed dt
+    double dt = this->eta * sqrt(tree.leafSize(i) / acc);
+    double longest = delta * (1 << this->span);
+    int l = 0;
+    while (l < this->span + this->levels && longest / (1 << l) > dt) {
+        l++;
+    }
+    return l;
+}
+
+void
+BlockIntegrator::step(double delta, bool parallel) {
+    if (outsideParallel()) {
+        #pragma omp parallel if(parallel)
+        step(delta, parallel);
+        return;
+    }
+    int n = particles.size();
+    int ticks = 1 << this->levels;                  // ticks per delta
+    int period = 1 << (this->span + this->levels);  // ticks per longest step
+    double tick = delta / ticks;
+    double longest = delta * (1 << this->span);
+    int start = this->clock;
+    #pragma omp single
+    this->forceEvaluations = 0;
+
+    // First step needs forces and levels for every particle
+    if (!this->started) {
+        #pragma omp single
+        {
+            active.resize(n);
+            for (int i = 0; i < n; i++) {
+                active[i] = i;
+            }
+        }
+        computeForces();
+        #pragma omp for
+        for (int i = 0; i < n; i++) {
+            level[i] = chooseLevel(i, delta);
+        }
+        #pragma omp single
+        this->started = true;
+    }
+
+    for (int t = 0; t < ticks; t++) {
+        int c = (start + t) % period;
+
+        // Opening half kick for particles whose step starts on this tick,
+        // then drift every particle
+        #pragma omp for
+        for (int i = 0; i < n; i++) {
+            if (c % (period >> level[i]) == 0) {
+                double half = 0.5 * longest / (1 << level[i]);
+                particles.vx[i] += particles.ax[i] * half;
+                particles.vy[i] += particles.ay[i] * half;
+                particles.vz[i] += particles.az[i] * half;
+            }
+            particles.x[i] += particles.vx[i] * tick;
+            particles.y[i] += particles.vy[i] * tick;
+            particles.z[i] += particles.vz[i] * tick;
+        }
+
+        // Particles whose step ends on the next tick
+        #pragma omp single
+        {
+            active.clear();
+            for (int i = 0; i < n; i++) {
+                if ((c + 1) % (period >> level[i]) == 0) {
+                    active.push_back(i);
+                }
+            }
+            this->rebuild = false;
+        }
+        if (active.empty()) {
+            continue;
+        }
+
+        // Bring tree up to date with the drifted positions
+        #pragma omp for
+        for (int i = 0; i < n; i++) {
+            if (tree.checkParticleBounds(i)) {
+                #pragma omp atomic write
+                this->rebuild = true;
+            }
+        }
+        if (this->rebuild) {
+            tree.build();
+        }
+        tree.setCenterOfMass();
+        computeForces();
+
+        // Closing half kick and level of the next step. Moving to a longer
+        // step has to wait for a tick where the longer block starts.
+        int numActive = (int)active.size();
+        #pragma omp for
+        for (int k = 0; k < numActive; k++) {
+            int i = active[k];
+            double half = 0.5 * longest / (1 << level[i]);
+            particles.vx[i] += particles.ax[i] * half;
+            particles.vy[i] += particles.ay[i] * half;
+            particles.vz[i] += particles.az[i] * half;
+            int next = chooseLevel(i, delta);
+            if (next > level[i]) {
+                level[i] = next;
+            }
+            while (next < level[i] && (c + 1) % (period >> (level[i] - 1)) == 0) {
+                level[i]--;
+            }
+        }
+    }
+    #pragma omp single
+    this->clock = (start + ticks) % period;
+}
+
+void
+BlockIntegrator::reorder(const std::vector<int> &order) {
+    particles.permute(order);
+    parallelGather(level, order);
+}
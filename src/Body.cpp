@@ -16,6 +16,7 @@ Body::Body() {
     this->pos = zero_vect();
     this->acc = zero_vect();
     this->vel = zero_vect();
+    this->accMag = 0.0;
 }
 
 /* Partial constructor (no initial acceleration or velocity) */
@@ -25,6 +26,7 @@ Body::Body(int id, double mass, const vector_3d& pos) {
     this->pos = pos;
     this->acc = zero_vect();
     this->vel = zero_vect();
+    this->accMag = 0.0;
 }
 
 /* Full constructor */
@@ -34,6 +36,7 @@ Body::Body(int id, double mass, const vector_3d& pos, const vector_3d& acc, cons
     this->pos = pos;
     this->acc = acc;
     this->vel = vel;
+    this->accMag = 0.0;
 }
 
 /* Override "<<" operator for printing body details to I/O output stream */
@@ -53,7 +56,7 @@ Body::distance(const Body& b) {
     double xDiff = (std::get<X>(b.pos) - std::get<X>(this->pos)) * xScale;
     double yDiff = (std::get<Y>(b.pos) - std::get<Y>(this->pos)) * yScale;
     double zDiff = (std::get<Z>(b.pos) - std::get<Z>(this->pos)) * zScale;
-    return sqrt(pow(xDiff, 2) + pow(yDiff, 2) + pow(zDiff, 2));
+    return sqrt(xDiff * xDiff + yDiff * yDiff + zDiff * zDiff);
 }
 
 /* Calculate the gravitational force vector on this body produced by body b */
@@ -66,7 +69,7 @@ Body::force(const Body& b) {
     // first, calculate gravitational force vector if distance not zero, otherwise zero force
     if (dist != 0) {
         // f_mag = (G * m1 * m2) / (d^2)
-        mag = (G * this->mass * b.mass) / pow(dist, 2);
+        mag = (G * this->mass * b.mass) / (dist * dist);
 
         // f_x = ((x1 - x2) / d) * f_mag
         std::get<X>(f) = ((std::get<X>(b.pos) - std::get<X>(this->pos)) * xScale) / dist * mag;
@@ -84,6 +87,8 @@ Body::apply(const vector_3d f) {
     std::get<X>(this->acc) += (std::get<X>(f) / this->mass);
     std::get<Y>(this->acc) += (std::get<Y>(f) / this->mass);
     std::get<Z>(this->acc) += (std::get<Z>(f) / this->mass);
+    this->accMag = sqrt(std::get<X>(f) * std::get<X>(f) + std::get<Y>(f) * std::get<Y>(f) +
+                        std::get<Z>(f) * std::get<Z>(f)) / this->mass;
 }
 
 /* Simulate movement of this body for t seconds given initial acceleration and velocity */
@@ -91,7 +96,7 @@ void
 Body::move(double t) {
     // update position
     // Newton's Second Equation of Motion : x = x_0 + (v * t) + (0.5 * a * (t^2))
-    double temp = 0.5 * pow(t, 2);
+    double temp = 0.5 * t * t;
     std::get<X>(this->pos) += (std::get<X>(this->vel) * t) + (std::get<X>(this->acc) * temp);
     std::get<Y>(this->pos) += (std::get<Y>(this->vel) * t) + (std::get<Y>(this->acc) * temp);
     std::get<Z>(this->pos) += (std::get<Z>(this->vel) * t) + (std::get<Z>(this->acc) * temp);
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: CostZones.cpp
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "CostZones.h"
+
+CostZones::CostZones(int numParticles) {
+    this->balanced = true;
+    char *balance = std::getenv("BALANCE");
+    if (balance != NULL && *balance != '\0') {
+        if (strcmp(balance, "static") == 0) {
+            this->balanced = false;
+        } else if (strcmp(balance, "zones") != 0) {
+            std::cerr << "ignoring BALANCE=" << balance << " (expected zones or static)" <<
+                std::endl;
+        }
+    }
+    this->cost.assign(numParticles, 0.0);
+    this->order = nullptr;
+}
+
+void
+CostZones::partition(const std::vector<int> *order, int numZones) {
+    int n = (int)cost.size();
+    this->order = order;
+    bounds.assign(numZones + 1, n);
+    bounds[0] = 0;
+
+    double total = 0.0;
+    if (this->balanced) {
+        for (int i = 0; i < n; i++) {
+            total += cost[i];
+        }
+    }
+    if (total <= 0.0) {
+        // Nothing recorded yet: equal particle counts
+        for (int z = 1; z < numZones; z++) {
+            bounds[z] = (int)((long long)n * z / numZones);
+        }
+        return;
+    }
+
+    // Zone z ends where the running cost first reaches z / numZones of the total
+    double running = 0.0;
+    int z = 1;
+    for (int s = 0; s < n && z < numZones; s++) {
+        running += cost[particle(s)];
+        while (z < numZones && running >= total * z / numZones) {
+            bounds[z++] = s + 1;
+        }
+    }
+}
+
+void
+CostZones::permute(const std::vector<int> &order) {
+    std::vector<double> ordered(order.size());
+    for (int s = 0; s < (int)order.size(); s++) {
+        ordered[s] = cost[order[s]];
+    }
+    cost.swap(ordered);
+}
+
+void
+CostZones::reset() {
+    cost.assign(cost.size(), 0.0);
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: DirectSum.cpp
+ */
+
+#include <algorithm>
+#include "DirectSum.h"
+#include "Kernels.h"
+
+DirectSum::DirectSum(Particles &particles) : particles(particles) {}
+
+void
+DirectSum::tilePair(int a, int b) {
+    int n = particles.size();
+    int first = std::min(a, b), second = std::max(a, b);
+    int begin = first * DIRECT_TILE;
+    int end = std::min(n, begin + DIRECT_TILE);
+    int sourceBegin = second * DIRECT_TILE;
+    int sourceEnd = std::min(n, sourceBegin + DIRECT_TILE);
+    accumulatePairs(particles.x.data(), particles.y.data(), particles.z.data(),
+                    particles.mass.data(), begin, end, sourceBegin, sourceEnd,
+                    accX.data(), accY.data(), accZ.data());
+}
+
+void
+DirectSum::forces(bool parallel) {
+    int n = particles.size();
+    int numTiles = (n + DIRECT_TILE - 1) / DIRECT_TILE;
+    // Rounds pair up an even number of slots, the last one empty for an odd
+    // number of tiles
+    int slots = numTiles + numTiles % 2;
+    accX.resize(n);
+    accY.resize(n);
+    accZ.resize(n);
+
+    #pragma omp parallel if(parallel)
+    {
+        #pragma omp for schedule(static)
+        for (int i = 0; i < n; i++) {
+            accX[i] = accY[i] = accZ[i] = 0.0;
+        }
+
+        // Every tile is paired with itself, then with every other tile in
+        // slots - 1 rounds (circle method). Pairs of a round share no tile,
+        // so threads only ever write the rows of their own pairs.
+        #pragma omp for schedule(dynamic, 1)
+        for (int tile = 0; tile < numTiles; tile++) {
+            tilePair(tile, tile);
+        }
+        for (int round = 0; round < slots - 1; round++) {
+            #pragma omp for schedule(dynamic, 1)
+            for (int k = 0; k < slots / 2; k++) {
+                int a = k == 0 ? slots - 1 : (round + k) % (slots - 1);
+                int b = (round - k + slots - 1) % (slots - 1);
+                if (a < numTiles) {
+                    tilePair(a, b);
+                }
+            }
+        }
+
+        // Apply the total force
+        #pragma omp for schedule(static)
+        for (int i = 0; i < n; i++) {
+            double scale = G * particles.mass[i];
+            particles.apply(i, std::make_tuple(scale * accX[i], scale * accY[i],
+                                               scale * accZ[i]));
+        }
+    }
+}
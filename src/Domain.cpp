@@ -0,0 +1,257 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Domain.cpp
+ */
+
+#include <algorithm>
+#include <cfloat>
+#include "Domain.h"
+#include "LinearOctTree.h"
+#include "Parallel.h"
+
+constexpr int BODY_VALUES = 13;  // doubles per packed body: id, mass, pos, acc, vel, accMag, work
+constexpr int MASS_VALUES = 4;   // doubles per point mass: x, y, z, mass
+
+/* Pack body and its work into BODY_VALUES doubles at v */
+static void packBody(const Body &body, double work, double *v) {
+    v[0] = body.id;
+    v[1] = body.mass;
+    v[2] = std::get<X>(body.pos);
+    v[3] = std::get<Y>(body.pos);
+    v[4] = std::get<Z>(body.pos);
+    v[5] = std::get<X>(body.acc);
+    v[6] = std::get<Y>(body.acc);
+    v[7] = std::get<Z>(body.acc);
+    v[8] = std::get<X>(body.vel);
+    v[9] = std::get<Y>(body.vel);
+    v[10] = std::get<Z>(body.vel);
+    v[11] = body.accMag;
+    v[12] = work;
+}
+
+/* Unpack the body at v, storing its work */
+static Body unpackBody(const double *v, double &work) {
+    Body body = Body((int)v[0], v[1], std::make_tuple(v[2], v[3], v[4]),
+                     std::make_tuple(v[5], v[6], v[7]), std::make_tuple(v[8], v[9], v[10]));
+    body.accMag = v[11];
+    work = v[12];
+    return body;
+}
+
+/* Bounding box of bodies in lower and upper, with lower > upper if there are none */
+static void bodyBounds(const std::vector<Body> &bodies, double *lower, double *upper) {
+    double lx = DBL_MAX, ly = DBL_MAX, lz = DBL_MAX;
+    double ux = -DBL_MAX, uy = -DBL_MAX, uz = -DBL_MAX;
+    int n = (int)bodies.size();
+    #pragma omp parallel for reduction(min:lx,ly,lz) reduction(max:ux,uy,uz)
+    for (int i = 0; i < n; i++) {
+        const vector_3d &pos = bodies[i].pos;
+        lx = std::min(lx, std::get<X>(pos));
+        ly = std::min(ly, std::get<Y>(pos));
+        lz = std::min(lz, std::get<Z>(pos));
+        ux = std::max(ux, std::get<X>(pos));
+        uy = std::max(uy, std::get<Y>(pos));
+        uz = std::max(uz, std::get<Z>(pos));
+    }
+    lower[X] = lx;
+    lower[Y] = ly;
+    lower[Z] = lz;
+    upper[X] = ux;
+    upper[Y] = uy;
+    upper[Z] = uz;
+}
+
+/* Exchange values between all ranks. Counts are numbers of doubles sent to
+ * (received from) each rank, values for each rank are consecutive in send. */
+static void exchangeValues(const std::vector<double> &send, const std::vector<int> &sendCounts,
+                           std::vector<double> &recv, int numRanks) {
+    std::vector<int> recvCounts(numRanks);
+    MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    std::vector<int> sendDispls(numRanks, 0), recvDispls(numRanks, 0);
+    for (int r = 1; r < numRanks; r++) {
+        sendDispls[r] = sendDispls[r - 1] + sendCounts[r - 1];
+        recvDispls[r] = recvDispls[r - 1] + recvCounts[r - 1];
+    }
+    recv.resize(recvDispls[numRanks - 1] + recvCounts[numRanks - 1]);
+    MPI_Alltoallv(send.data(), sendCounts.data(), sendDispls.data(), MPI_DOUBLE, recv.data(),
+                  recvCounts.data(), recvDispls.data(), MPI_DOUBLE, MPI_COMM_WORLD);
+}
+
+Domain::Domain() {
+    MPI_Comm_rank(MPI_COMM_WORLD, &this->rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &this->numRanks);
+    this->splitters.assign(this->numRanks, 0);
+    this->imported = 0;
+}
+
+void
+Domain::globalBounds(const std::vector<Body> &bodies) {
+    double lower[3], upper[3];
+    bodyBounds(bodies, lower, upper);
+    MPI_Allreduce(MPI_IN_PLACE, lower, 3, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, upper, 3, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    for (int k = 0; k < 3; k++) {
+        // keep the grid well defined when all bodies share a coordinate
+        if (!(upper[k] > lower[k])) {
+            upper[k] = lower[k] + 1.0;
+        }
+    }
+    this->lowerBound = std::make_tuple(lower[X], lower[Y], lower[Z]);
+    this->upperBound = std::make_tuple(upper[X], upper[Y], upper[Z]);
+}
+
+void
+Domain::chooseSplitters(const std::vector<std::pair<uint64_t, int>> &keys,
+                        const std::vector<double> &work) {
+    // Work of the first s local bodies in curve order
+    int n = (int)keys.size();
+    std::vector<double> before(n + 1, 0.0);
+    for (int s = 0; s < n; s++) {
+        before[s + 1] = before[s] + work[keys[s].second];
+    }
+    double total = before[n];
+    MPI_Allreduce(MPI_IN_PLACE, &total, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    // Bisect all splitters at once: splitter r is the first key at which the
+    // work of all bodies before it reaches r shares of the total
+    std::vector<uint64_t> lo(this->numRanks, 0), hi(this->numRanks, 0);
+    std::vector<double> below(this->numRanks, 0.0);
+    for (int r = 1; r < this->numRanks; r++) {
+        hi[r] = (uint64_t)1 << (DIMENSIONS * MAX_DEPTH);
+    }
+    for (int bit = 0; bit <= DIMENSIONS * MAX_DEPTH; bit++) {
+        for (int r = 1; r < this->numRanks; r++) {
+            uint64_t mid = lo[r] + (hi[r] - lo[r]) / 2;
+            auto first = std::lower_bound(keys.begin(), keys.end(), mid,
+                [](const std::pair<uint64_t, int> &key, uint64_t value) {
+                    return key.first < value;
+                });
+            below[r] = before[first - keys.begin()];
+        }
+        MPI_Allreduce(MPI_IN_PLACE, below.data(), this->numRanks, MPI_DOUBLE, MPI_SUM,
+                      MPI_COMM_WORLD);
+        for (int r = 1; r < this->numRanks; r++) {
+            uint64_t mid = lo[r] + (hi[r] - lo[r]) / 2;
+            if (below[r] < total * r / this->numRanks) {
+                lo[r] = std::min(hi[r], mid + 1);
+            } else {
+                hi[r] = mid;
+            }
+        }
+    }
+    for (int r = 0; r < this->numRanks; r++) {
+        this->splitters[r] = lo[r];
+    }
+}
+
+void
+Domain::decompose(std::vector<Body> &bodies, std::vector<double> &work) {
+    globalBounds(bodies);
+
+    // Order local bodies along the curve
+    int n = (int)bodies.size();
+    std::vector<std::pair<uint64_t, int>> keys(n);
+    #pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+        keys[i] = std::make_pair(mortonKey(bodies[i].pos, this->lowerBound, this->upperBound), i);
+    }
+    parallelSort(keys);
+    chooseSplitters(keys, work);
+
+    // Bodies in curve order are grouped by the rank owning them: rank r owns
+    // those from the first key at or past its splitter up to the next rank's
+    std::vector<int> first(this->numRanks + 1, 0);
+    for (int r = 1; r < this->numRanks; r++) {
+        auto key = std::lower_bound(keys.begin(), keys.end(), this->splitters[r],
+            [](const std::pair<uint64_t, int> &key, uint64_t value) {
+                return key.first < value;
+            });
+        first[r] = std::max(first[r - 1], (int)(key - keys.begin()));
+    }
+    first[this->numRanks] = n;
+    std::vector<int> sendCounts(this->numRanks);
+    for (int r = 0; r < this->numRanks; r++) {
+        sendCounts[r] = (first[r + 1] - first[r]) * BODY_VALUES;
+    }
+    std::vector<double> send((size_t)n * BODY_VALUES);
+    #pragma omp parallel for
+    for (int s = 0; s < n; s++) {
+        int i = keys[s].second;
+        packBody(bodies[i], work[i], &send[(size_t)s * BODY_VALUES]);
+    }
+    std::vector<double> recv;
+    exchangeValues(send, sendCounts, recv, this->numRanks);
+
+    int received = (int)(recv.size() / BODY_VALUES);
+    bodies.resize(received);
+    work.resize(received);
+    #pragma omp parallel for
+    for (int i = 0; i < received; i++) {
+        bodies[i] = unpackBody(&recv[(size_t)i * BODY_VALUES], work[i]);
+    }
+}
+
+void
+Domain::exchange(OctTree &tree, const std::vector<Body> &bodies, std::vector<double> &masses) {
+    // Bounding box of the bodies of every rank, empty when lower > upper
+    double box[6];
+    bodyBounds(bodies, box, box + 3);
+    std::vector<double> boxes(6 * this->numRanks);
+    MPI_Allgather(box, 6, MPI_DOUBLE, boxes.data(), 6, MPI_DOUBLE, MPI_COMM_WORLD);
+
+    // Walk the local tree once for every other rank's box, appending what it
+    // needs to send. Each walk is shared by all threads (OctTree.h), so the
+    // team is used however few ranks there are.
+    std::vector<double> send;
+    std::vector<int> sendCounts(this->numRanks, 0);
+    for (int r = 0; r < this->numRanks; r++) {
+        const double *b = &boxes[6 * r];
+        if (r == this->rank || b[0] > b[3]) {
+            continue;
+        }
+        size_t before = send.size();
+        tree.essentialBodies(std::make_tuple(b[0], b[1], b[2]), std::make_tuple(b[3], b[4], b[5]),
+                             send);
+        sendCounts[r] = (int)(send.size() - before);
+    }
+    exchangeValues(send, sendCounts, masses, this->numRanks);
+    this->imported = (long)(masses.size() / MASS_VALUES);
+}
+
+void
+Domain::gather(const std::vector<Body> &bodies, std::vector<Body> &all) {
+    int n = (int)bodies.size();
+    std::vector<double> send((size_t)n * BODY_VALUES);
+    #pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+        packBody(bodies[i], 0.0, &send[(size_t)i * BODY_VALUES]);
+    }
+    int count = (int)send.size();
+    std::vector<int> counts(this->numRanks), displs(this->numRanks, 0);
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    for (int r = 1; r < this->numRanks; r++) {
+        displs[r] = displs[r - 1] + counts[r - 1];
+    }
+    std::vector<double> recv;
+    if (this->rank == 0) {
+        recv.resize(displs[this->numRanks - 1] + counts[this->numRanks - 1]);
+    }
+    MPI_Gatherv(send.data(), count, MPI_DOUBLE, recv.data(), counts.data(), displs.data(),
+                MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    all.clear();
+    if (this->rank != 0) {
+        return;
+    }
+    int received = (int)(recv.size() / BODY_VALUES);
+    all.resize(received);
+    #pragma omp parallel for
+    for (int i = 0; i < received; i++) {
+        double work;
+        all[i] = unpackBody(&recv[(size_t)i * BODY_VALUES], work);
+    }
+    std::sort(all.begin(), all.end(), [](const Body &a, const Body &b) {
+        return a.id < b.id;
+    });
+}
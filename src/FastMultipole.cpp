@@ -0,0 +1,258 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: FastMultipole.cpp
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "FastMultipole.h"
+#include "Kernels.h"
+#include "Parallel.h"
+
+FastMultipole::FastMultipole(LinearOctTree &tree) : tree(tree) {
+    this->theta = positiveEnv("FMM_THETA", DEFAULT_FMM_THETA);
+}
+
+void
+FastMultipole::nodeRadius(int node) {
+    double cx = tree.comX[node], cy = tree.comY[node], cz = tree.comZ[node];
+    double r = 0.0;
+    if (tree.childCount[node] == 0) {
+        int begin = tree.bodyBegin[node];
+        for (int s = begin; s < begin + tree.bodyCount[node]; s++) {
+            double dx = (tree.bodyX[s] - cx) * xScale;
+            double dy = (tree.bodyY[s] - cy) * yScale;
+            double dz = (tree.bodyZ[s] - cz) * zScale;
+            r = std::max(r, dx * dx + dy * dy + dz * dz);
+        }
+        r = sqrt(r);
+    } else {
+        int begin = tree.childBegin[node];
+        for (int c = begin; c < begin + tree.childCount[node]; c++) {
+            double dx = (tree.comX[c] - cx) * xScale;
+            double dy = (tree.comY[c] - cy) * yScale;
+            double dz = (tree.comZ[c] - cz) * zScale;
+            r = std::max(r, sqrt(dx * dx + dy * dy + dz * dz) + radius[c]);
+        }
+    }
+    radius[node] = r;
+}
+
+void
+FastMultipole::setRadius() {
+    // Children only depend on the level below them, so sweep levels from
+    // the deepest up with the nodes of each level split across threads.
+    // Runs of narrow levels are swept in reverse by one thread instead.
+    const std::vector<int> &levels = tree.levels;
+    int level = (int)levels.size() - 2;
+    while (level >= 0) {
+        if (levels[level + 1] - levels[level] >= LEVEL_NODES) {
+            #pragma omp for
+            for (int node = levels[level]; node < levels[level + 1]; node++) {
+                nodeRadius(node);
+            }
+            level--;
+            continue;
+        }
+        int top = level;
+        while (top >= 0 && levels[top + 1] - levels[top] < LEVEL_NODES) {
+            top--;
+        }
+        #pragma omp single
+        for (int node = levels[level + 1] - 1; node >= levels[top + 1]; node--) {
+            nodeRadius(node);
+        }
+        level = top;
+    }
+}
+
+void
+FastMultipole::forces(bool parallel) {
+    if (outsideParallel()) {
+        #pragma omp parallel if(parallel)
+        forces(parallel);
+        return;
+    }
+    int numNodes = tree.numNodes();
+    int numBodies = (int)tree.order.size();
+
+    #pragma omp single
+    {
+        radius.resize(numNodes);
+        fieldX.resize(numNodes);
+        fieldY.resize(numNodes);
+        fieldZ.resize(numNodes);
+        gradXX.resize(numNodes);
+        gradXY.resize(numNodes);
+        gradXZ.resize(numNodes);
+        gradYY.resize(numNodes);
+        gradYZ.resize(numNodes);
+        gradZZ.resize(numNodes);
+        accX.resize(numBodies);
+        accY.resize(numBodies);
+        accZ.resize(numBodies);
+    }
+    #pragma omp for nowait
+    for (int node = 0; node < numNodes; node++) {
+        fieldX[node] = fieldY[node] = fieldZ[node] = 0.0;
+        gradXX[node] = gradXY[node] = gradXZ[node] = 0.0;
+        gradYY[node] = gradYZ[node] = gradZZ[node] = 0.0;
+    }
+    #pragma omp for
+    for (int s = 0; s < numBodies; s++) {
+        accX[s] = accY[s] = accZ[s] = 0.0;
+    }
+    setRadius();
+
+    // One thread starts the walk and the team runs it as tasks. Tasks only
+    // ever split the target cell, so concurrent tasks always own disjoint
+    // target subtrees and never write the same expansion or body.
+    #pragma omp single
+    interact(0, 0);
+
+    passDown();
+}
+
+void
+FastMultipole::interact(int a, int b) {
+    int aBegin = tree.bodyBegin[a], aEnd = aBegin + tree.bodyCount[a];
+    int bBegin = tree.bodyBegin[b], bEnd = bBegin + tree.bodyCount[b];
+    if (aEnd <= bBegin || bEnd <= aBegin) {
+        double dx = (tree.comX[b] - tree.comX[a]) * xScale;
+        double dy = (tree.comY[b] - tree.comY[a]) * yScale;
+        double dz = (tree.comZ[b] - tree.comZ[a]) * zScale;
+        double reach = radius[a] + radius[b];
+        if (reach * reach < this->theta * this->theta * (dx * dx + dy * dy + dz * dz)) {
+            // cells are well separated
+            cellCell(a, b);
+            return;
+        }
+    }
+
+    // Bodies of a cell are contiguous, so small cells are summed like leaves
+    bool aLeaf = tree.childCount[a] == 0 || tree.bodyCount[a] <= FMM_LEAF_BODIES;
+    bool bLeaf = tree.childCount[b] == 0 || tree.bodyCount[b] <= FMM_LEAF_BODIES;
+    if (aLeaf && bLeaf) {
+        bodyBody(a, b);
+    } else if (bLeaf || (!aLeaf && tree.size[a] >= tree.size[b])) {
+        // split target cell, children own disjoint targets
+        int begin = tree.childBegin[a];
+        for (int c = begin; c < begin + tree.childCount[a]; c++) {
+            #pragma omp task if(tree.bodyCount[c] > FMM_TASK_BODIES)
+            interact(c, b);
+        }
+        #pragma omp taskwait
+    } else {
+        // split source cell, target stays within this task
+        int begin = tree.childBegin[b];
+        for (int c = begin; c < begin + tree.childCount[b]; c++) {
+            interact(a, c);
+        }
+    }
+}
+
+// Add the field of source b's monopole and its gradient about target a's
+// center of mass to a's local expansion
+void
+FastMultipole::cellCell(int a, int b) {
+    double dx = (tree.comX[b] - tree.comX[a]) * xScale;
+    double dy = (tree.comY[b] - tree.comY[a]) * yScale;
+    double dz = (tree.comZ[b] - tree.comZ[a]) * zScale;
+    double distSq = dx * dx + dy * dy + dz * dz;
+    double inv = 1.0 / sqrt(distSq);
+    double inv3 = tree.mass[b] * inv * inv * inv;
+    double inv5 = 3.0 * inv3 * inv * inv;
+    fieldX[a] += dx * inv3;
+    fieldY[a] += dy * inv3;
+    fieldZ[a] += dz * inv3;
+    gradXX[a] += dx * dx * inv5 - inv3;
+    gradXY[a] += dx * dy * inv5;
+    gradXZ[a] += dx * dz * inv5;
+    gradYY[a] += dy * dy * inv5 - inv3;
+    gradYZ[a] += dy * dz * inv5;
+    gradZZ[a] += dz * dz * inv5 - inv3;
+}
+
+// Sum every body of source cell b directly at every body of target cell a,
+// the kernel skips a body acting on itself (zero distance)
+void
+FastMultipole::bodyBody(int a, int b) {
+    int aBegin = tree.bodyBegin[a];
+    int bBegin = tree.bodyBegin[b];
+    int bCount = tree.bodyCount[b];
+    for (int s = aBegin; s < aBegin + tree.bodyCount[a]; s++) {
+        double acc[3] = {0.0, 0.0, 0.0};
+        accumulateAccel(&tree.bodyX[bBegin], &tree.bodyY[bBegin], &tree.bodyZ[bBegin],
+                        &tree.bodyMass[bBegin], bCount, tree.bodyX[s], tree.bodyY[s],
+                        tree.bodyZ[s], acc);
+        accX[s] += acc[0];
+        accY[s] += acc[1];
+        accZ[s] += acc[2];
+    }
+}
+
+void
+FastMultipole::shiftDown(int node) {
+    int begin = tree.childBegin[node];
+    for (int c = begin; c < begin + tree.childCount[node]; c++) {
+        double dx = (tree.comX[c] - tree.comX[node]) * xScale;
+        double dy = (tree.comY[c] - tree.comY[node]) * yScale;
+        double dz = (tree.comZ[c] - tree.comZ[node]) * zScale;
+        fieldX[c] += fieldX[node] + gradXX[node] * dx + gradXY[node] * dy + gradXZ[node] * dz;
+        fieldY[c] += fieldY[node] + gradXY[node] * dx + gradYY[node] * dy + gradYZ[node] * dz;
+        fieldZ[c] += fieldZ[node] + gradXZ[node] * dx + gradYZ[node] * dy + gradZZ[node] * dz;
+        gradXX[c] += gradXX[node];
+        gradXY[c] += gradXY[node];
+        gradXZ[c] += gradXZ[node];
+        gradYY[c] += gradYY[node];
+        gradYZ[c] += gradYZ[node];
+        gradZZ[c] += gradZZ[node];
+    }
+}
+
+void
+FastMultipole::passDown() {
+    // Shift every local expansion to the children's centers of mass. Each
+    // child has one parent, so sweep levels from the root down with the
+    // parents of each level split across threads. Nodes are stored level by
+    // level, so runs of narrow levels are swept forward by one thread instead.
+    const std::vector<int> &levels = tree.levels;
+    int numLevels = (int)levels.size() - 1;
+    int level = 0;
+    while (level < numLevels) {
+        if (levels[level + 1] - levels[level] >= LEVEL_NODES) {
+            #pragma omp for
+            for (int node = levels[level]; node < levels[level + 1]; node++) {
+                shiftDown(node);
+            }
+            level++;
+            continue;
+        }
+        int bottom = level;
+        while (bottom < numLevels && levels[bottom + 1] - levels[bottom] < LEVEL_NODES) {
+            bottom++;
+        }
+        #pragma omp single
+        for (int node = levels[level]; node < levels[bottom]; node++) {
+            shiftDown(node);
+        }
+        level = bottom;
+    }
+
+    // Evaluate each leaf's expansion at its bodies and apply the total force
+    int numBodies = (int)tree.order.size();
+    #pragma omp for
+    for (int s = 0; s < numBodies; s++) {
+        int i = tree.order[s];
+        int leaf = tree.leafOf[i];
+        double dx = (tree.bodyX[s] - tree.comX[leaf]) * xScale;
+        double dy = (tree.bodyY[s] - tree.comY[leaf]) * yScale;
+        double dz = (tree.bodyZ[s] - tree.comZ[leaf]) * zScale;
+        double ax = accX[s] + fieldX[leaf] + gradXX[leaf] * dx + gradXY[leaf] * dy + gradXZ[leaf] * dz;
+        double ay = accY[s] + fieldY[leaf] + gradXY[leaf] * dx + gradYY[leaf] * dy + gradYZ[leaf] * dz;
+        double az = accZ[s] + fieldZ[leaf] + gradXZ[leaf] * dx + gradYZ[leaf] * dy + gradZZ[leaf] * dz;
+        double scale = G * tree.bodyMass[s];
+        tree.particles.apply(i, std::make_tuple(scale * ax, scale * ay, scale * az));
+    }
+}
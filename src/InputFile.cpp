@@ -0,0 +1,246 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: InputFile.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "InputFile.h"
+
+static_assert(sizeof(InputHeader) == 160, "InputHeader layout must not change within a version");
+
+/* Size in bytes of one value of column c */
+static size_t columnWidth(int c) {
+    return c == 0 ? sizeof(int32_t) : sizeof(double);
+}
+
+/* Round offset up to the next multiple of INPUT_ALIGN */
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + INPUT_ALIGN - 1) / INPUT_ALIGN * INPUT_ALIGN;
+}
+
+/* Read simulation bounds from text input file */
+static vector_3d getBounds(std::ifstream &f) {
+    double x, y, z;
+    f >> x >> y >> z;
+    if (DIMENSIONS == 2) {
+        z = 0.0;
+    }
+    return std::make_tuple(x, y, z);
+}
+
+InputFile::InputFile(const char *path) {
+    this->count = 0;
+    this->lowerBound = zero_vect();
+    this->upperBound = zero_vect();
+    this->map = nullptr;
+    this->mapLength = 0;
+    this->ids = nullptr;
+    std::fill(this->columns, this->columns + INPUT_COLUMNS - 1, nullptr);
+
+    char magic[sizeof(INPUT_MAGIC)] = {};
+    std::ifstream f(path, std::ios::in | std::ios::binary);
+    if (!f.is_open()) {
+        this->opened = false;
+        return;
+    }
+    f.read(magic, sizeof(magic));
+    f.close();
+    if (memcmp(magic, INPUT_MAGIC, sizeof(INPUT_MAGIC)) == 0) {
+        this->opened = mapBinary(path);
+    } else {
+        this->opened = readText(path);
+    }
+}
+
+InputFile::~InputFile() {
+    if (this->map != nullptr) {
+        munmap(this->map, this->mapLength);
+    }
+}
+
+bool
+InputFile::readText(const char *path) {
+    std::ifstream f(path, std::ios::in);
+    if (!f.is_open()) {
+        return false;
+    }
+    f >> this->count;
+    if (f.fail() || this->count < 0) {
+        std::cerr << path << ": invalid body count" << std::endl;
+        return false;
+    }
+    this->lowerBound = getBounds(f);
+    this->upperBound = getBounds(f);
+    if (f.fail()) {
+        std::cerr << path << ": invalid simulation bounds" << std::endl;
+        return false;
+    }
+    this->ownedIds.resize(this->count);
+    for (int c = 0; c < INPUT_COLUMNS - 1; c++) {
+        this->owned[c].resize(this->count);
+        this->columns[c] = this->owned[c].data();
+    }
+    this->ids = this->ownedIds.data();
+    for (int i = 0; i < this->count; i++) {
+        Body b = getBody(f);
+        if (f.fail()) {
+            std::cerr << path << ": invalid or missing body " << i << " of " << this->count <<
+                std::endl;
+            return false;
+        }
+        this->ownedIds[i] = b.id;
+        this->owned[0][i] = b.mass;
+        this->owned[1][i] = std::get<X>(b.pos);
+        this->owned[2][i] = std::get<Y>(b.pos);
+        this->owned[3][i] = std::get<Z>(b.pos);
+        this->owned[4][i] = std::get<X>(b.acc);
+        this->owned[5][i] = std::get<Y>(b.acc);
+        this->owned[6][i] = std::get<Z>(b.acc);
+        this->owned[7][i] = std::get<X>(b.vel);
+        this->owned[8][i] = std::get<Y>(b.vel);
+        this->owned[9][i] = std::get<Z>(b.vel);
+    }
+    return true;
+}
+
+bool
+InputFile::mapBinary(const char *path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(InputHeader)) {
+        std::cerr << path << ": truncated input header" << std::endl;
+        close(fd);
+        return false;
+    }
+    this->mapLength = (size_t)st.st_size;
+    this->map = mmap(nullptr, this->mapLength, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (this->map == MAP_FAILED) {
+        std::cerr << path << ": unable to map input file" << std::endl;
+        this->map = nullptr;
+        return false;
+    }
+
+    // Check the header before trusting any offset in it
+    const char *base = (const char *)this->map;
+    const InputHeader *header = (const InputHeader *)base;
+    if (header->version != INPUT_VERSION) {
+        std::cerr << path << ": input version " << header->version << " is not supported"
+                  << " (expected " << INPUT_VERSION << ")" << std::endl;
+        return false;
+    }
+    if (header->count > (uint64_t)INT32_MAX) {
+        std::cerr << path << ": too many bodies (" << header->count << ")" << std::endl;
+        return false;
+    }
+    for (int c = 0; c < INPUT_COLUMNS; c++) {
+        uint64_t offset = header->offsets[c];
+        if (offset % INPUT_ALIGN != 0 || offset > this->mapLength
+                || header->count * columnWidth(c) > this->mapLength - offset) {
+            std::cerr << path << ": input column " << c << " is out of bounds" << std::endl;
+            return false;
+        }
+    }
+
+    this->count = (int)header->count;
+    double lz = DIMENSIONS == 2 ? 0.0 : header->lower[Z];
+    double uz = DIMENSIONS == 2 ? 0.0 : header->upper[Z];
+    this->lowerBound = std::make_tuple(header->lower[X], header->lower[Y], lz);
+    this->upperBound = std::make_tuple(header->upper[X], header->upper[Y], uz);
+    this->ids = (const int32_t *)(base + header->offsets[0]);
+    for (int c = 1; c < INPUT_COLUMNS; c++) {
+        this->columns[c - 1] = (const double *)(base + header->offsets[c]);
+    }
+    return true;
+}
+
+Body
+InputFile::body(int i) const {
+    const double *const *v = this->columns;
+    // planar simulation: project onto the x/y plane, as getBody does
+    double z = DIMENSIONS == 2 ? 0.0 : v[3][i];
+    double az = DIMENSIONS == 2 ? 0.0 : v[6][i];
+    double vz = DIMENSIONS == 2 ? 0.0 : v[9][i];
+    return Body(this->ids[i], v[0][i], std::make_tuple(v[1][i], v[2][i], z),
+                std::make_tuple(v[4][i], v[5][i], az), std::make_tuple(v[7][i], v[8][i], vz));
+}
+
+/* Write column c of bodies, in blocks so no full copy of the column is made */
+static void writeColumn(std::ofstream &f, const std::vector<Body> &bodies, int c) {
+    constexpr size_t BLOCK = 1 << 16;
+    std::vector<char> block(BLOCK * sizeof(double));
+    for (size_t begin = 0; begin < bodies.size(); begin += BLOCK) {
+        size_t end = std::min(bodies.size(), begin + BLOCK);
+        char *out = block.data();
+        for (size_t i = begin; i < end; i++) {
+            const Body &b = bodies[i];
+            if (c == 0) {
+                int32_t id = b.id;
+                memcpy(out, &id, sizeof(id));
+                out += sizeof(id);
+                continue;
+            }
+            double values[INPUT_COLUMNS - 1] = {
+                b.mass,
+                std::get<X>(b.pos), std::get<Y>(b.pos), std::get<Z>(b.pos),
+                std::get<X>(b.acc), std::get<Y>(b.acc), std::get<Z>(b.acc),
+                std::get<X>(b.vel), std::get<Y>(b.vel), std::get<Z>(b.vel)
+            };
+            memcpy(out, &values[c - 1], sizeof(double));
+            out += sizeof(double);
+        }
+        f.write(block.data(), out - block.data());
+    }
+}
+
+bool
+writeBinaryInput(const char *path, const std::vector<Body> &bodies, const vector_3d &lower,
+                 const vector_3d &upper) {
+    std::ofstream f(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!f.is_open()) {
+        std::cerr << "Unable to open " << path << std::endl;
+        return false;
+    }
+
+    InputHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INPUT_MAGIC, sizeof(INPUT_MAGIC));
+    header.version = INPUT_VERSION;
+    header.count = bodies.size();
+    header.lower[X] = std::get<X>(lower);
+    header.lower[Y] = std::get<Y>(lower);
+    header.lower[Z] = std::get<Z>(lower);
+    header.upper[X] = std::get<X>(upper);
+    header.upper[Y] = std::get<Y>(upper);
+    header.upper[Z] = std::get<Z>(upper);
+    uint64_t offset = alignOffset(sizeof(header));
+    for (int c = 0; c < INPUT_COLUMNS; c++) {
+        header.offsets[c] = offset;
+        offset = alignOffset(offset + bodies.size() * columnWidth(c));
+    }
+
+    // Header and columns, each padded with zeros to the next column
+    const char padding[INPUT_ALIGN] = {};
+    f.write((const char *)&header, sizeof(header));
+    uint64_t written = sizeof(header);
+    for (int c = 0; c < INPUT_COLUMNS; c++) {
+        f.write(padding, header.offsets[c] - written);
+        writeColumn(f, bodies, c);
+        written = header.offsets[c] + bodies.size() * columnWidth(c);
+    }
+    f.close();
+    if (f.fail()) {
+        std::cerr << "Unable to write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
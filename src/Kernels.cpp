@@ -0,0 +1,456 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Kernels.cpp
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <immintrin.h>
+#include "Body.h"
+#include "Kernels.h"
+
+typedef void (*accel_kernel)(const double *, const double *, const double *, const double *,
+                             int, double, double, double, double *);
+typedef void (*accel_mixed_kernel)(const float *, const float *, const float *, const float *,
+                                   int, float, float, float, double *);
+typedef void (*move_kernel)(double *, double *, double *, double *, double *, double *,
+                            const double *, const double *, const double *, int, int, double);
+typedef void (*pair_kernel)(const double *, const double *, const double *, const double *,
+                            int, int, int, int, double *, double *, double *);
+
+/* Scalar kernels */
+
+// Interactions of one call are evaluated and summed in real precision, and
+// the sums of all calls are accumulated in double
+template <typename real>
+static inline __attribute__((always_inline)) void
+accelLoop(const real *x, const real *y, const real *z, const real *m, int n,
+          real px, real py, real pz, double *acc) {
+    real ax = 0, ay = 0, az = 0;
+    #pragma omp simd reduction(+:ax,ay,az)
+    for (int k = 0; k < n; k++) {
+        real dx = (x[k] - px) * (real)xScale;
+        real dy = (y[k] - py) * (real)yScale;
+        real dz = 0, distSq = dx * dx + dy * dy;
+        if (DIMENSIONS == 3) {
+            dz = (z[k] - pz) * (real)zScale;
+            distSq += dz * dz;
+        }
+        real scale = distSq > 0 ? m[k] / (distSq * std::sqrt(distSq)) : (real)0;
+        ax += dx * scale;
+        ay += dy * scale;
+        if (DIMENSIONS == 3) {
+            az += dz * scale;
+        }
+    }
+    acc[0] += ax;
+    acc[1] += ay;
+    acc[2] += az;
+}
+
+static void
+accelScalar(const double *x, const double *y, const double *z, const double *m, int n,
+            double px, double py, double pz, double *acc) {
+    accelLoop(x, y, z, m, n, px, py, pz, acc);
+}
+
+static void
+accelScalarMixed(const float *x, const float *y, const float *z, const float *m, int n,
+                 float px, float py, float pz, double *acc) {
+    accelLoop(x, y, z, m, n, px, py, pz, acc);
+}
+
+// Newton's Second and First Equations of Motion, acceleration remains constant
+static inline __attribute__((always_inline)) void
+moveLoop(double *x, double *y, double *z, double *vx, double *vy, double *vz,
+         const double *ax, const double *ay, const double *az, int begin, int end, double t) {
+    double temp = 0.5 * t * t;
+    #pragma omp simd
+    for (int k = begin; k < end; k++) {
+        x[k] += (vx[k] * t) + (ax[k] * temp);
+        y[k] += (vy[k] * t) + (ay[k] * temp);
+        vx[k] += ax[k] * t;
+        vy[k] += ay[k] * t;
+        if (DIMENSIONS == 3) {
+            z[k] += (vz[k] * t) + (az[k] * temp);
+            vz[k] += az[k] * t;
+        }
+    }
+}
+
+// Every pair (i, j) with i in [begin, end), j in [sourceBegin, sourceEnd) and
+// j > i is evaluated once and its equal and opposite acceleration terms are
+// added to both bodies. Exact division keeps direct summation a reference.
+static inline __attribute__((always_inline)) void
+pairLoop(const double *x, const double *y, const double *z, const double *m, int begin,
+         int end, int sourceBegin, int sourceEnd, double *ax, double *ay, double *az) {
+    for (int i = begin; i < end; i++) {
+        double px = x[i], py = y[i], pz = z[i], pm = m[i];
+        double accX = 0.0, accY = 0.0, accZ = 0.0;
+        #pragma omp simd reduction(+:accX,accY,accZ)
+        for (int j = std::max(sourceBegin, i + 1); j < sourceEnd; j++) {
+            double dx = (x[j] - px) * xScale;
+            double dy = (y[j] - py) * yScale;
+            double dz = 0.0, distSq = dx * dx + dy * dy;
+            if (DIMENSIONS == 3) {
+                dz = (z[j] - pz) * zScale;
+                distSq += dz * dz;
+            }
+            double inv3 = distSq > 0 ? 1.0 / (distSq * sqrt(distSq)) : 0.0;
+            accX += dx * (m[j] * inv3);
+            accY += dy * (m[j] * inv3);
+            ax[j] -= dx * (pm * inv3);
+            ay[j] -= dy * (pm * inv3);
+            if (DIMENSIONS == 3) {
+                accZ += dz * (m[j] * inv3);
+                az[j] -= dz * (pm * inv3);
+            }
+        }
+        ax[i] += accX;
+        ay[i] += accY;
+        az[i] += accZ;
+    }
+}
+
+static void
+pairScalar(const double *x, const double *y, const double *z, const double *m, int begin,
+           int end, int sourceBegin, int sourceEnd, double *ax, double *ay, double *az) {
+    pairLoop(x, y, z, m, begin, end, sourceBegin, sourceEnd, ax, ay, az);
+}
+
+static void
+moveScalar(double *x, double *y, double *z, double *vx, double *vy, double *vz,
+           const double *ax, const double *ay, const double *az, int begin, int end, double t) {
+    moveLoop(x, y, z, vx, vy, vz, ax, ay, az, begin, end, t);
+}
+
+/* AVX2 kernels */
+
+// Inverse square root from the bit-level initial guess (relative error below
+// 3.5%, valid over the full double range) refined by four Newton steps
+__attribute__((target("avx2,fma"))) static inline __m256d
+rsqrtAvx2(__m256d r2) {
+    __m256i bits = _mm256_castpd_si256(r2);
+    bits = _mm256_sub_epi64(_mm256_set1_epi64x(0x5fe6eb50c7b537a9LL), _mm256_srli_epi64(bits, 1));
+    __m256d y = _mm256_castsi256_pd(bits);
+    __m256d half = _mm256_mul_pd(r2, _mm256_set1_pd(0.5));
+    __m256d threeHalves = _mm256_set1_pd(1.5);
+    for (int k = 0; k < 4; k++) {
+        y = _mm256_mul_pd(y, _mm256_fnmadd_pd(half, _mm256_mul_pd(y, y), threeHalves));
+    }
+    return y;
+}
+
+__attribute__((target("avx2,fma"))) static inline double
+sumAvx2(__m256d v) {
+    __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+__attribute__((target("avx2,fma"))) static void
+accelAvx2(const double *x, const double *y, const double *z, const double *m, int n,
+          double px, double py, double pz, double *acc) {
+    __m256d vpx = _mm256_set1_pd(px), vpy = _mm256_set1_pd(py), vpz = _mm256_set1_pd(pz);
+    __m256d xs = _mm256_set1_pd(xScale), ys = _mm256_set1_pd(yScale), zs = _mm256_set1_pd(zScale);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d ax = zero, ay = zero, az = zero;
+    int k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m256d dx = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(x + k), vpx), xs);
+        __m256d dy = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(y + k), vpy), ys);
+        __m256d dz = zero, distSq = _mm256_mul_pd(dy, dy);
+        if (DIMENSIONS == 3) {
+            dz = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(z + k), vpz), zs);
+            distSq = _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dz, dz));
+        }
+        distSq = _mm256_fmadd_pd(dx, dx, distSq);
+        __m256d inv = rsqrtAvx2(distSq);
+        __m256d scale = _mm256_mul_pd(_mm256_loadu_pd(m + k),
+                                      _mm256_mul_pd(inv, _mm256_mul_pd(inv, inv)));
+        // zero distance (the body itself) contributes nothing
+        scale = _mm256_and_pd(scale, _mm256_cmp_pd(distSq, zero, _CMP_GT_OQ));
+        ax = _mm256_fmadd_pd(dx, scale, ax);
+        ay = _mm256_fmadd_pd(dy, scale, ay);
+        if (DIMENSIONS == 3) {
+            az = _mm256_fmadd_pd(dz, scale, az);
+        }
+    }
+    acc[0] += sumAvx2(ax);
+    acc[1] += sumAvx2(ay);
+    acc[2] += sumAvx2(az);
+    if (k < n) {
+        accelScalar(x + k, y + k, z + k, m + k, n - k, px, py, pz, acc);
+    }
+}
+
+// Single precision inverse square root: 12 bit hardware estimate refined by
+// one Newton step
+__attribute__((target("avx2,fma"))) static inline __m256
+rsqrtAvx2Mixed(__m256 r2) {
+    __m256 y = _mm256_rsqrt_ps(r2);
+    __m256 half = _mm256_mul_ps(r2, _mm256_set1_ps(0.5f));
+    return _mm256_mul_ps(y, _mm256_fnmadd_ps(half, _mm256_mul_ps(y, y), _mm256_set1_ps(1.5f)));
+}
+
+// Sum the eight single precision lanes of v in double precision
+__attribute__((target("avx2,fma"))) static inline double
+sumAvx2Mixed(__m256 v) {
+    return sumAvx2(_mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)),
+                                 _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1))));
+}
+
+__attribute__((target("avx2,fma"))) static void
+accelAvx2Mixed(const float *x, const float *y, const float *z, const float *m, int n,
+               float px, float py, float pz, double *acc) {
+    __m256 vpx = _mm256_set1_ps(px), vpy = _mm256_set1_ps(py), vpz = _mm256_set1_ps(pz);
+    __m256 xs = _mm256_set1_ps(xScale), ys = _mm256_set1_ps(yScale), zs = _mm256_set1_ps(zScale);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 ax = zero, ay = zero, az = zero;
+    int k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m256 dx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + k), vpx), xs);
+        __m256 dy = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(y + k), vpy), ys);
+        __m256 dz = zero, distSq = _mm256_mul_ps(dy, dy);
+        if (DIMENSIONS == 3) {
+            dz = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(z + k), vpz), zs);
+            distSq = _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz));
+        }
+        distSq = _mm256_fmadd_ps(dx, dx, distSq);
+        __m256 inv = rsqrtAvx2Mixed(distSq);
+        __m256 scale = _mm256_mul_ps(_mm256_loadu_ps(m + k),
+                                     _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+        // zero distance (the body itself) contributes nothing
+        scale = _mm256_and_ps(scale, _mm256_cmp_ps(distSq, zero, _CMP_GT_OQ));
+        ax = _mm256_fmadd_ps(dx, scale, ax);
+        ay = _mm256_fmadd_ps(dy, scale, ay);
+        if (DIMENSIONS == 3) {
+            az = _mm256_fmadd_ps(dz, scale, az);
+        }
+    }
+    acc[0] += sumAvx2Mixed(ax);
+    acc[1] += sumAvx2Mixed(ay);
+    acc[2] += sumAvx2Mixed(az);
+    if (k < n) {
+        accelScalarMixed(x + k, y + k, z + k, m + k, n - k, px, py, pz, acc);
+    }
+}
+
+__attribute__((target("avx2,fma"))) static void
+moveAvx2(double *x, double *y, double *z, double *vx, double *vy, double *vz,
+         const double *ax, const double *ay, const double *az, int begin, int end, double t) {
+    moveLoop(x, y, z, vx, vy, vz, ax, ay, az, begin, end, t);
+}
+
+__attribute__((target("avx2,fma"))) static void
+pairAvx2(const double *x, const double *y, const double *z, const double *m, int begin,
+         int end, int sourceBegin, int sourceEnd, double *ax, double *ay, double *az) {
+    pairLoop(x, y, z, m, begin, end, sourceBegin, sourceEnd, ax, ay, az);
+}
+
+/* AVX-512 kernels */
+
+// Inverse square root from the 14 bit hardware estimate refined by two Newton steps
+__attribute__((target("avx512f"))) static inline __m512d
+rsqrtAvx512(__m512d r2) {
+    __m512d y = _mm512_maskz_rsqrt14_pd((__mmask8)0xff, r2);
+    __m512d half = _mm512_mul_pd(r2, _mm512_set1_pd(0.5));
+    __m512d threeHalves = _mm512_set1_pd(1.5);
+    for (int k = 0; k < 2; k++) {
+        y = _mm512_mul_pd(y, _mm512_fnmadd_pd(half, _mm512_mul_pd(y, y), threeHalves));
+    }
+    return y;
+}
+
+__attribute__((target("avx512f"))) static inline double
+sumAvx512(__m512d v) {
+    alignas(64) double lanes[8];
+    _mm512_store_pd(lanes, v);
+    return ((lanes[0] + lanes[4]) + (lanes[1] + lanes[5])) +
+           ((lanes[2] + lanes[6]) + (lanes[3] + lanes[7]));
+}
+
+__attribute__((target("avx512f"))) static void
+accelAvx512(const double *x, const double *y, const double *z, const double *m, int n,
+            double px, double py, double pz, double *acc) {
+    __m512d vpx = _mm512_set1_pd(px), vpy = _mm512_set1_pd(py), vpz = _mm512_set1_pd(pz);
+    __m512d xs = _mm512_set1_pd(xScale), ys = _mm512_set1_pd(yScale), zs = _mm512_set1_pd(zScale);
+    __m512d zero = _mm512_setzero_pd();
+    __m512d ax = zero, ay = zero, az = zero;
+    for (int k = 0; k < n; k += 8) {
+        // masked loads cover the tail, so there is no scalar remainder
+        __mmask8 lanes = n - k >= 8 ? (__mmask8)0xff : (__mmask8)((1u << (n - k)) - 1);
+        __m512d dx = _mm512_mul_pd(_mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, x + k), vpx), xs);
+        __m512d dy = _mm512_mul_pd(_mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, y + k), vpy), ys);
+        __m512d dz = zero, distSq = _mm512_mul_pd(dy, dy);
+        if (DIMENSIONS == 3) {
+            dz = _mm512_mul_pd(_mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, z + k), vpz), zs);
+            distSq = _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dz, dz));
+        }
+        distSq = _mm512_fmadd_pd(dx, dx, distSq);
+        __m512d inv = rsqrtAvx512(distSq);
+        // inactive lanes and zero distance (the body itself) contribute nothing
+        __mmask8 active = _mm512_mask_cmp_pd_mask(lanes, distSq, zero, _CMP_GT_OQ);
+        __m512d scale = _mm512_maskz_mul_pd(active, _mm512_maskz_loadu_pd(lanes, m + k),
+                                            _mm512_mul_pd(inv, _mm512_mul_pd(inv, inv)));
+        ax = _mm512_fmadd_pd(dx, scale, ax);
+        ay = _mm512_fmadd_pd(dy, scale, ay);
+        if (DIMENSIONS == 3) {
+            az = _mm512_fmadd_pd(dz, scale, az);
+        }
+    }
+    acc[0] += sumAvx512(ax);
+    acc[1] += sumAvx512(ay);
+    acc[2] += sumAvx512(az);
+}
+
+// Single precision inverse square root: 14 bit hardware estimate refined by
+// one Newton step
+__attribute__((target("avx512f"))) static inline __m512
+rsqrtAvx512Mixed(__m512 r2) {
+    __m512 y = _mm512_maskz_rsqrt14_ps((__mmask16)0xffff, r2);
+    __m512 half = _mm512_mul_ps(r2, _mm512_set1_ps(0.5f));
+    return _mm512_mul_ps(y, _mm512_fnmadd_ps(half, _mm512_mul_ps(y, y), _mm512_set1_ps(1.5f)));
+}
+
+// Sum the sixteen single precision lanes of v in double precision
+__attribute__((target("avx512f"))) static inline double
+sumAvx512Mixed(__m512 v) {
+    __m512d bits = _mm512_castps_pd(v);
+    __m256 low = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd((__mmask8)0xf, bits, 0));
+    __m256 high = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd((__mmask8)0xf, bits, 1));
+    return sumAvx512(_mm512_add_pd(_mm512_maskz_cvtps_pd((__mmask8)0xff, low),
+                                   _mm512_maskz_cvtps_pd((__mmask8)0xff, high)));
+}
+
+__attribute__((target("avx512f"))) static void
+accelAvx512Mixed(const float *x, const float *y, const float *z, const float *m, int n,
+                 float px, float py, float pz, double *acc) {
+    __m512 vpx = _mm512_set1_ps(px), vpy = _mm512_set1_ps(py), vpz = _mm512_set1_ps(pz);
+    __m512 xs = _mm512_set1_ps(xScale), ys = _mm512_set1_ps(yScale), zs = _mm512_set1_ps(zScale);
+    __m512 zero = _mm512_setzero_ps();
+    __m512 ax = zero, ay = zero, az = zero;
+    for (int k = 0; k < n; k += 16) {
+        // masked loads cover the tail, so there is no scalar remainder
+        __mmask16 lanes = n - k >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << (n - k)) - 1);
+        __m512 dx = _mm512_mul_ps(_mm512_sub_ps(_mm512_maskz_loadu_ps(lanes, x + k), vpx), xs);
+        __m512 dy = _mm512_mul_ps(_mm512_sub_ps(_mm512_maskz_loadu_ps(lanes, y + k), vpy), ys);
+        __m512 dz = zero, distSq = _mm512_mul_ps(dy, dy);
+        if (DIMENSIONS == 3) {
+            dz = _mm512_mul_ps(_mm512_sub_ps(_mm512_maskz_loadu_ps(lanes, z + k), vpz), zs);
+            distSq = _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz));
+        }
+        distSq = _mm512_fmadd_ps(dx, dx, distSq);
+        __m512 inv = rsqrtAvx512Mixed(distSq);
+        // inactive lanes and zero distance (the body itself) contribute nothing
+        __mmask16 active = _mm512_mask_cmp_ps_mask(lanes, distSq, zero, _CMP_GT_OQ);
+        __m512 scale = _mm512_maskz_mul_ps(active, _mm512_maskz_loadu_ps(lanes, m + k),
+                                           _mm512_mul_ps(inv, _mm512_mul_ps(inv, inv)));
+        ax = _mm512_fmadd_ps(dx, scale, ax);
+        ay = _mm512_fmadd_ps(dy, scale, ay);
+        if (DIMENSIONS == 3) {
+            az = _mm512_fmadd_ps(dz, scale, az);
+        }
+    }
+    acc[0] += sumAvx512Mixed(ax);
+    acc[1] += sumAvx512Mixed(ay);
+    acc[2] += sumAvx512Mixed(az);
+}
+
+__attribute__((target("avx512f"))) static void
+moveAvx512(double *x, double *y, double *z, double *vx, double *vy, double *vz,
+           const double *ax, const double *ay, const double *az, int begin, int end, double t) {
+    moveLoop(x, y, z, vx, vy, vz, ax, ay, az, begin, end, t);
+}
+
+__attribute__((target("avx512f"))) static void
+pairAvx512(const double *x, const double *y, const double *z, const double *m, int begin,
+           int end, int sourceBegin, int sourceEnd, double *ax, double *ay, double *az) {
+    pairLoop(x, y, z, m, begin, end, sourceBegin, sourceEnd, ax, ay, az);
+}
+
+/* Runtime dispatch */
+
+enum KernelLevel {SCALAR, AVX2, AVX512};
+
+struct KernelTable {
+    accel_kernel accel;
+    accel_mixed_kernel accelMixed;
+    move_kernel move;
+    pair_kernel pair;
+    const char *name;
+};
+
+static KernelTable
+selectKernels() {
+    // Widest instruction set supported by the CPU
+    KernelLevel level = SCALAR;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        level = AVX512;
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        level = AVX2;
+    }
+
+    // KERNEL may only narrow the selection
+    char *kernel = std::getenv("KERNEL");
+    if (kernel != NULL && *kernel != '\0') {
+        if (strcmp(kernel, "scalar") == 0) {
+            level = SCALAR;
+        } else if (strcmp(kernel, "avx2") == 0 && level >= AVX2) {
+            level = AVX2;
+        } else if (strcmp(kernel, "avx512") != 0 || level < AVX512) {
+            std::cerr << "ignoring KERNEL=" << kernel <<
+                " (expected scalar, avx2 or avx512 supported by this CPU)" << std::endl;
+        }
+    }
+
+    switch (level) {
+    case AVX512:
+        return KernelTable{accelAvx512, accelAvx512Mixed, moveAvx512, pairAvx512, "avx512"};
+    case AVX2:
+        return KernelTable{accelAvx2, accelAvx2Mixed, moveAvx2, pairAvx2, "avx2"};
+    default:
+        return KernelTable{accelScalar, accelScalarMixed, moveScalar, pairScalar, "scalar"};
+    }
+}
+
+static const KernelTable &
+kernels() {
+    static const KernelTable table = selectKernels();
+    return table;
+}
+
+void
+accumulateAccel(const double *x, const double *y, const double *z, const double *m,
+                int n, double px, double py, double pz, double acc[3]) {
+    kernels().accel(x, y, z, m, n, px, py, pz, acc);
+}
+
+void
+accumulateAccel(const float *x, const float *y, const float *z, const float *m,
+                int n, float px, float py, float pz, double acc[3]) {
+    kernels().accelMixed(x, y, z, m, n, px, py, pz, acc);
+}
+
+void
+moveBodies(double *x, double *y, double *z, double *vx, double *vy, double *vz,
+           const double *ax, const double *ay, const double *az, int begin, int end,
+           double t) {
+    kernels().move(x, y, z, vx, vy, vz, ax, ay, az, begin, end, t);
+}
+
+void
+accumulatePairs(const double *x, const double *y, const double *z, const double *m,
+                int begin, int end, int sourceBegin, int sourceEnd, double *ax, double *ay,
+                double *az) {
+    kernels().pair(x, y, z, m, begin, end, sourceBegin, sourceEnd, ax, ay, az);
+}
+
+const char *
+kernelName() {
+    return kernels().name;
+}
@@ -0,0 +1,698 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: LinearOctTree.cpp
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "Kernels.h"
+#include "LinearOctTree.h"
+#include "Parallel.h"
+
+// Octet bits of the upper half along each axis: bit 2 for x, bit 1 for y
+// and bit 0 for z (bit 1 for x and bit 0 for y in a planar quadtree)
+constexpr int UPPER_X = 1 << (DIMENSIONS - 1);
+constexpr int UPPER_Y = 1 << (DIMENSIONS - 2);
+constexpr int UPPER_Z = 1;
+
+/* Construct LinearOctTree given list of particles */
+LinearOctTree::LinearOctTree(Particles &particles, vector_3d lowerBound,
+                             vector_3d upperBound) : particles(particles),
+                                                     lowerBound(lowerBound),
+                                                     upperBound(upperBound) {
+    // Cache maximum number of bodies per leaf bucket
+    char *bucket = std::getenv("BUCKET_SIZE");
+    this->bucketSize = bucket == NULL ? LEAF_BUCKET_SIZE : std::max(1, atoi(bucket));
+    char *group = std::getenv("GROUP_SIZE");
+    this->groupSize = group == NULL ? GROUP_BODIES : std::max(1, atoi(group));
+    this->mixed = false;
+    char *precision = std::getenv("PRECISION");
+    if (precision != NULL && *precision != '\0') {
+        if (strcmp(precision, "mixed") == 0) {
+            this->mixed = true;
+        } else if (strcmp(precision, "double") != 0) {
+            std::cerr << "ignoring PRECISION=" << precision << " (expected double or mixed)" <<
+                std::endl;
+        }
+    }
+    this->originX = this->originY = this->originZ = 0.0;
+    this->massUnit = 1.0;
+
+    build();
+}
+
+void
+LinearOctTree::setNode(int node, double lx, double ly, double lz, double ux, double uy,
+                       double uz, int begin, int count) {
+    lowerX[node] = lx;
+    lowerY[node] = ly;
+    lowerZ[node] = lz;
+    upperX[node] = ux;
+    upperY[node] = uy;
+    upperZ[node] = uz;
+    size[node] = std::max(ux - lx, std::max(uy - ly, uz - lz));
+    bmax[node] = 0.0;
+    mass[node] = 0.0;
+    comX[node] = 0.0;
+    comY[node] = 0.0;
+    comZ[node] = 0.0;
+    childBegin[node] = 0;
+    childCount[node] = 0;
+    bodyBegin[node] = begin;
+    bodyCount[node] = count;
+}
+
+void
+LinearOctTree::resizeNodes(int n) {
+    // Grow capacity geometrically, first touching new storage from all threads
+    // of the team
+    if ((size_t)n > mass.capacity()) {
+        size_t capacity = std::max((size_t)n, 2 * mass.capacity());
+        reserveParallel(lowerX, capacity);
+        reserveParallel(lowerY, capacity);
+        reserveParallel(lowerZ, capacity);
+        reserveParallel(upperX, capacity);
+        reserveParallel(upperY, capacity);
+        reserveParallel(upperZ, capacity);
+        reserveParallel(size, capacity);
+        reserveParallel(bmax, capacity);
+        reserveParallel(mass, capacity);
+        reserveParallel(comX, capacity);
+        reserveParallel(comY, capacity);
+        reserveParallel(comZ, capacity);
+        reserveParallel(childBegin, capacity);
+        reserveParallel(childCount, capacity);
+        reserveParallel(bodyBegin, capacity);
+        reserveParallel(bodyCount, capacity);
+    }
+    #pragma omp single
+    {
+        lowerX.resize(n);
+        lowerY.resize(n);
+        lowerZ.resize(n);
+        upperX.resize(n);
+        upperY.resize(n);
+        upperZ.resize(n);
+        size.resize(n);
+        bmax.resize(n);
+        mass.resize(n);
+        comX.resize(n);
+        comY.resize(n);
+        comZ.resize(n);
+        childBegin.resize(n);
+        childCount.resize(n);
+        bodyBegin.resize(n);
+        bodyCount.resize(n);
+    }
+}
+
+// Spread the low 21 bits of v so that there are two zero bits between each
+static inline uint64_t spreadBits(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8) & 0x100f00f00f00f00fULL;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2) & 0x1249249249249249ULL;
+    return v;
+}
+
+// Quantize coordinate onto the 2^MAX_DEPTH grid spanning [lower, upper]
+static inline uint64_t quantize(double value, double lower, double upper) {
+    double cell = (value - lower) / (upper - lower) * (double)(1 << MAX_DEPTH);
+    if (cell < 0) {
+        return 0;
+    }
+    if (cell >= (double)((1 << MAX_DEPTH) - 1)) {
+        return (1 << MAX_DEPTH) - 1;
+    }
+    return (uint64_t)cell;
+}
+
+// Spread the low 21 bits of v so that there is one zero bit between each
+static inline uint64_t spreadBitsPlanar(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 16) & 0x0000ffff0000ffffULL;
+    v = (v | v << 8) & 0x00ff00ff00ff00ffULL;
+    v = (v | v << 4) & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | v << 2) & 0x3333333333333333ULL;
+    v = (v | v << 1) & 0x5555555555555555ULL;
+    return v;
+}
+
+uint64_t
+mortonKey(const vector_3d &pos, const vector_3d &lower, const vector_3d &upper) {
+    uint64_t qx = quantize(std::get<X>(pos), std::get<X>(lower), std::get<X>(upper));
+    uint64_t qy = quantize(std::get<Y>(pos), std::get<Y>(lower), std::get<Y>(upper));
+    if (DIMENSIONS == 2) {
+        return (spreadBitsPlanar(qx) << 1) | spreadBitsPlanar(qy);
+    }
+    uint64_t qz = quantize(std::get<Z>(pos), std::get<Z>(lower), std::get<Z>(upper));
+    return (spreadBits(qx) << 2) | (spreadBits(qy) << 1) | spreadBits(qz);
+}
+
+uint64_t
+LinearOctTree::mortonKey(double x, double y, double z) {
+    // Same encoding as Domain's splitters, over the bounds of the root
+    return ::mortonKey(std::make_tuple(x, y, z), std::make_tuple(lowerX[0], lowerY[0], lowerZ[0]),
+                       std::make_tuple(upperX[0], upperY[0], upperZ[0]));
+}
+
+void
+LinearOctTree::build() {
+    if (outsideParallel()) {
+        #pragma omp parallel
+        build();
+        return;
+    }
+    int n = (int)particles.size();
+
+    // Root node is always node 0 and covers the simulation bounds and every
+    // body, so bodies that escape never pile up on the root's edges
+    double minX = std::get<X>(lowerBound), maxX = std::get<X>(upperBound);
+    double minY = std::get<Y>(lowerBound), maxY = std::get<Y>(upperBound);
+    double minZ = std::get<Z>(lowerBound), maxZ = std::get<Z>(upperBound);
+    #pragma omp single
+    {
+        this->fitLower = lowerBound;
+        this->fitUpper = upperBound;
+    }
+    #pragma omp for nowait
+    for (int i = 0; i < n; i++) {
+        minX = std::min(minX, particles.x[i]);
+        minY = std::min(minY, particles.y[i]);
+        minZ = std::min(minZ, particles.z[i]);
+        maxX = std::max(maxX, particles.x[i]);
+        maxY = std::max(maxY, particles.y[i]);
+        maxZ = std::max(maxZ, particles.z[i]);
+    }
+    #pragma omp critical
+    {
+        std::get<X>(this->fitLower) = std::min(std::get<X>(this->fitLower), minX);
+        std::get<Y>(this->fitLower) = std::min(std::get<Y>(this->fitLower), minY);
+        std::get<Z>(this->fitLower) = std::min(std::get<Z>(this->fitLower), minZ);
+        std::get<X>(this->fitUpper) = std::max(std::get<X>(this->fitUpper), maxX);
+        std::get<Y>(this->fitUpper) = std::max(std::get<Y>(this->fitUpper), maxY);
+        std::get<Z>(this->fitUpper) = std::max(std::get<Z>(this->fitUpper), maxZ);
+    }
+    resizeNodes(1);
+    #pragma omp single
+    {
+        setNode(0, std::get<X>(this->fitLower), std::get<Y>(this->fitLower),
+                std::get<Z>(this->fitLower), std::get<X>(this->fitUpper),
+                std::get<Y>(this->fitUpper), std::get<Z>(this->fitUpper), 0, n);
+        keys.resize(n);
+    }
+
+    // Compute Morton keys of all bodies against the root bounds and sort them
+    #pragma omp for
+    for (int i = 0; i < n; i++) {
+        keys[i] = std::make_pair(mortonKey(particles.x[i], particles.y[i], particles.z[i]), i);
+    }
+    parallelSort(keys);
+
+    #pragma omp single
+    {
+        order.resize(n);
+        leafOf.resize(n);
+        levels.clear();
+    }
+    #pragma omp for
+    for (int s = 0; s < n; s++) {
+        order[s] = keys[s].second;
+    }
+
+    // Emit the tree one level at a time. Nodes of a level are contiguous, so
+    // the children of level [levelBegin, levelEnd) are placed right after it.
+    // Every thread walks the levels, sharing the nodes of each.
+    int levelBegin = 0;
+    int levelEnd = 1;
+    for (int depth = 0; levelBegin < levelEnd; depth++) {
+        int width = levelEnd - levelBegin;
+        #pragma omp single
+        {
+            levels.push_back(levelBegin);
+            offsets.assign(width, 0);
+        }
+
+        // Count non-empty octets of every node that must be split
+        #pragma omp for
+        for (int k = 0; k < width; k++) {
+            int node = levelBegin + k;
+            if (bodyCount[node] <= this->bucketSize || depth == MAX_DEPTH) {
+                continue;
+            }
+            int bounds[OCT_REGIONS + 1];
+            octetRanges(node, depth, bounds);
+            for (int o = 0; o < OCT_REGIONS; o++) {
+                offsets[k] += bounds[o + 1] > bounds[o];
+            }
+        }
+        int total = parallelExclusiveScan(offsets);
+        resizeNodes(levelEnd + total);
+
+        // Write children and mark leaves
+        #pragma omp for
+        for (int k = 0; k < width; k++) {
+            int node = levelBegin + k;
+            int begin = bodyBegin[node];
+            if (bodyCount[node] <= this->bucketSize || depth == MAX_DEPTH) {
+                childBegin[node] = 0;
+                childCount[node] = 0;
+                for (int s = begin; s < begin + bodyCount[node]; s++) {
+                    leafOf[order[s]] = node;
+                }
+                continue;
+            }
+            double lx = lowerX[node], ly = lowerY[node], lz = lowerZ[node];
+            double ux = upperX[node], uy = upperY[node], uz = upperZ[node];
+            double cx = (lx + ux) / 2, cy = (ly + uy) / 2, cz = (lz + uz) / 2;
+            int bounds[OCT_REGIONS + 1];
+            octetRanges(node, depth, bounds);
+            int child = levelEnd + offsets[k];
+            childBegin[node] = child;
+            childCount[node] = 0;
+            for (int o = 0; o < OCT_REGIONS; o++) {
+                if (bounds[o + 1] == bounds[o]) {
+                    continue;
+                }
+                // a planar quadtree keeps the parent's (flat) z bounds
+                double childLz = lz, childUz = uz;
+                if (DIMENSIONS == 3) {
+                    childLz = (o & UPPER_Z) ? cz : lz;
+                    childUz = (o & UPPER_Z) ? uz : cz;
+                }
+                setNode(child, (o & UPPER_X) ? cx : lx, (o & UPPER_Y) ? cy : ly, childLz,
+                        (o & UPPER_X) ? ux : cx, (o & UPPER_Y) ? uy : cy, childUz,
+                        bounds[o], bounds[o + 1] - bounds[o]);
+                childCount[node] += 1;
+                child++;
+            }
+        }
+        levelBegin = levelEnd;
+        levelEnd += total;
+    }
+    #pragma omp single
+    {
+        levels.push_back(levelEnd);
+        bodyX.resize(n);
+        bodyY.resize(n);
+        bodyZ.resize(n);
+        bodyMass.resize(n);
+        if (this->mixed) {
+            mixedX.resize(n);
+            mixedY.resize(n);
+            mixedZ.resize(n);
+            mixedMass.resize(n);
+        }
+        collectGroups();
+    }
+}
+
+void
+LinearOctTree::collectGroups() {
+    // Descend from the root until a node is small enough or a leaf
+    groups.clear();
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        if (bodyCount[node] <= this->groupSize || childCount[node] == 0) {
+            groups.push_back(node);
+            continue;
+        }
+        int begin = childBegin[node];
+        for (int c = begin + childCount[node] - 1; c >= begin; c--) {
+            stack.push_back(c);
+        }
+    }
+}
+
+// Find the range of sorted bodies of node falling into each octet at depth.
+// Keys within a node share their prefix, so the octet digit is sorted.
+void
+LinearOctTree::octetRanges(int node, int depth, int bounds[OCT_REGIONS + 1]) {
+    int shift = DIMENSIONS * (MAX_DEPTH - 1 - depth);
+    int begin = bodyBegin[node];
+    int end = begin + bodyCount[node];
+    bounds[0] = begin;
+    bounds[OCT_REGIONS] = end;
+    for (int o = 1; o < OCT_REGIONS; o++) {
+        int lo = bounds[o - 1], hi = end;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if ((int)((keys[mid].first >> shift) & (OCT_REGIONS - 1)) < o) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        bounds[o] = lo;
+    }
+}
+
+void
+LinearOctTree::setCenterOfMass() {
+    if (outsideParallel()) {
+        #pragma omp parallel
+        setCenterOfMass();
+        return;
+    }
+
+    // Refresh body data in tree order from current particle state
+    int n = (int)order.size();
+    int numLevels = (int)levels.size() - 1;
+    #pragma omp for
+    for (int s = 0; s < n; s++) {
+        int i = order[s];
+        bodyX[s] = particles.x[i];
+        bodyY[s] = particles.y[i];
+        bodyZ[s] = particles.z[i];
+        bodyMass[s] = particles.mass[i];
+    }
+
+    // Children only depend on the level below them, so sweep levels from
+    // the deepest up with the nodes of each level split across threads.
+    // Runs of narrow levels are swept in reverse by one thread instead.
+    int level = numLevels - 1;
+    while (level >= 0) {
+        if (levels[level + 1] - levels[level] >= LEVEL_NODES) {
+            #pragma omp for
+            for (int node = levels[level]; node < levels[level + 1]; node++) {
+                centerOfMass(node);
+            }
+            level--;
+            continue;
+        }
+        int top = level;
+        while (top >= 0 && levels[top + 1] - levels[top] < LEVEL_NODES) {
+            top--;
+        }
+        #pragma omp single
+        for (int node = levels[level + 1] - 1; node >= levels[top + 1]; node--) {
+            centerOfMass(node);
+        }
+        level = top;
+    }
+
+    // Single precision copies keep full relative precision near the root's
+    // center, and masses in units of the total mass stay within float range
+    if (this->mixed) {
+        #pragma omp single
+        {
+            this->originX = (lowerX[0] + upperX[0]) / 2;
+            this->originY = (lowerY[0] + upperY[0]) / 2;
+            this->originZ = (lowerZ[0] + upperZ[0]) / 2;
+            this->massUnit = mass[0] > 0 ? mass[0] : 1.0;
+        }
+        #pragma omp for
+        for (int s = 0; s < n; s++) {
+            mixedX[s] = (float)(bodyX[s] - this->originX);
+            mixedY[s] = (float)(bodyY[s] - this->originY);
+            mixedZ[s] = (float)(bodyZ[s] - this->originZ);
+            mixedMass[s] = (float)(bodyMass[s] / this->massUnit);
+        }
+    }
+}
+
+void
+LinearOctTree::centerOfMass(int node) {
+    double x = 0.0, y = 0.0, z = 0.0, m = 0.0;
+    if (bodyCount[node] == 1) {
+        // Keep the exact position so a particle never attracts itself
+        int s = bodyBegin[node];
+        mass[node] = bodyMass[s];
+        comX[node] = bodyX[s];
+        comY[node] = bodyY[s];
+        comZ[node] = bodyZ[s];
+        return;
+    } else if (childCount[node] == 0) {
+        int begin = bodyBegin[node];
+        for (int s = begin; s < begin + bodyCount[node]; s++) {
+            x += bodyMass[s] * bodyX[s];
+            y += bodyMass[s] * bodyY[s];
+            z += bodyMass[s] * bodyZ[s];
+            m += bodyMass[s];
+        }
+    } else {
+        int begin = childBegin[node];
+        for (int c = begin; c < begin + childCount[node]; c++) {
+            x += mass[c] * comX[c];
+            y += mass[c] * comY[c];
+            z += mass[c] * comZ[c];
+            m += mass[c];
+        }
+    }
+    mass[node] = m;
+    if (m != 0) {
+        comX[node] = x / m;
+        comY[node] = y / m;
+        comZ[node] = z / m;
+    } else {
+        comX[node] = (lowerX[node] + upperX[node]) / 2;
+        comY[node] = (lowerY[node] + upperY[node]) / 2;
+        comZ[node] = (lowerZ[node] + upperZ[node]) / 2;
+    }
+    double bx = std::max(comX[node] - lowerX[node], upperX[node] - comX[node]) * xScale;
+    double by = std::max(comY[node] - lowerY[node], upperY[node] - comY[node]) * yScale;
+    double bz = std::max(comZ[node] - lowerZ[node], upperZ[node] - comZ[node]) * zScale;
+    bmax[node] = sqrt(bx * bx + by * by + bz * bz);
+}
+
+void
+LinearOctTree::bodyArrays(BodyArrays<double> &arrays) const {
+    arrays.x = bodyX.data();
+    arrays.y = bodyY.data();
+    arrays.z = bodyZ.data();
+    arrays.mass = bodyMass.data();
+}
+
+void
+LinearOctTree::bodyArrays(BodyArrays<float> &arrays) const {
+    arrays.x = mixedX.data();
+    arrays.y = mixedY.data();
+    arrays.z = mixedZ.data();
+    arrays.mass = mixedMass.data();
+}
+
+// Point masses of nodes accepted during a tree walk, one list per thread
+template <typename real>
+struct InteractionList {
+    aligned_array<real> x, y, z, m;
+
+    void clear() {
+        x.clear();
+        y.clear();
+        z.clear();
+        m.clear();
+    }
+    void push(real px, real py, real pz, real pm) {
+        x.push_back(px);
+        y.push_back(py);
+        z.push_back(pz);
+        m.push_back(pm);
+    }
+};
+
+vector_3d
+LinearOctTree::treeForce(int i, int *interactions) {
+    return this->mixed ? walkForce<float>(i, interactions) : walkForce<double>(i, interactions);
+}
+
+template <typename real>
+vector_3d
+LinearOctTree::walkForce(int i, int *interactions) {
+    static thread_local InteractionList<real> list;
+    BodyArrays<real> bodies;
+    bodyArrays(bodies);
+    double px = particles.x[i];
+    double py = particles.y[i];
+    double pz = particles.z[i];
+    double accOld = particles.accMag[i];
+    double acc[3] = {0.0, 0.0, 0.0};
+    list.clear();
+
+    // Depth-first walk with an explicit stack of node indices. Accepted nodes
+    // are gathered into the interaction list, opened leaf buckets are summed
+    // in place, and both are evaluated by the SIMD kernel.
+    real kx = (real)(px - this->originX);
+    real ky = (real)(py - this->originY);
+    real kz = (real)(pz - this->originZ);
+    int stack[OCT_REGIONS * (MAX_DEPTH + 1)];
+    int top = 0;
+    int summed = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        int node = stack[--top];
+        double dx = (comX[node] - px) * xScale;
+        double dy = (comY[node] - py) * yScale;
+        double dz = (comZ[node] - pz) * zScale;
+        double distSq = dx * dx + dy * dy + dz * dz;
+        bool contains = opening.criterion == RELATIVE &&
+                        px >= lowerX[node] && px <= upperX[node] &&
+                        py >= lowerY[node] && py <= upperY[node] &&
+                        pz >= lowerZ[node] && pz <= upperZ[node];
+        if (bodyCount[node] == 1 ||
+            opening.accept(mass[node], size[node], bmax[node], distSq, accOld, contains)) {
+            // node only has a single body, or is far enough away
+            list.push((real)(comX[node] - this->originX), (real)(comY[node] - this->originY),
+                      (real)(comZ[node] - this->originZ), (real)(mass[node] / this->massUnit));
+        } else if (childCount[node] == 0) {
+            // leaf bucket too close: direct summation over its bodies, the
+            // kernel skips the particle itself (zero distance)
+            int begin = bodyBegin[node];
+            accumulateAccel(bodies.x + begin, bodies.y + begin, bodies.z + begin,
+                            bodies.mass + begin, bodyCount[node], kx, ky, kz, acc);
+            summed += bodyCount[node];
+        } else {
+            // node too close, need to follow all its children
+            int begin = childBegin[node];
+            for (int c = begin + childCount[node] - 1; c >= begin; c--) {
+                stack[top++] = c;
+            }
+        }
+    }
+    accumulateAccel(list.x.data(), list.y.data(), list.z.data(), list.m.data(),
+                    (int)list.m.size(), kx, ky, kz, acc);
+    if (interactions != nullptr) {
+        *interactions += summed + (int)list.m.size();
+    }
+
+    double scale = G * particles.mass[i] * this->massUnit;
+    return std::make_tuple(scale * acc[0], scale * acc[1], scale * acc[2]);
+}
+
+void
+LinearOctTree::groupForces(bool parallel) {
+    if (outsideParallel()) {
+        #pragma omp parallel if(parallel)
+        groupForces(parallel);
+        return;
+    }
+    int n = numGroups();
+    #pragma omp for schedule(dynamic)
+    for (int g = 0; g < n; g++) {
+        groupForce(groups[g]);
+    }
+}
+
+void
+LinearOctTree::groupForce(int group) {
+    if (this->mixed) {
+        walkGroup<float>(group);
+    } else {
+        walkGroup<double>(group);
+    }
+}
+
+template <typename real>
+void
+LinearOctTree::walkGroup(int group) {
+    static thread_local InteractionList<real> list;
+    BodyArrays<real> bodies;
+    bodyArrays(bodies);
+    list.clear();
+
+    // Bounding box and smallest previous acceleration of the bodies in the group
+    int groupBegin = bodyBegin[group];
+    int groupEnd = groupBegin + bodyCount[group];
+    double lx = bodyX[groupBegin], ly = bodyY[groupBegin], lz = bodyZ[groupBegin];
+    double ux = lx, uy = ly, uz = lz;
+    double accOld = particles.accMag[order[groupBegin]];
+    for (int s = groupBegin + 1; s < groupEnd; s++) {
+        accOld = std::min(accOld, particles.accMag[order[s]]);
+        lx = std::min(lx, bodyX[s]);
+        ly = std::min(ly, bodyY[s]);
+        lz = std::min(lz, bodyZ[s]);
+        ux = std::max(ux, bodyX[s]);
+        uy = std::max(uy, bodyY[s]);
+        uz = std::max(uz, bodyZ[s]);
+    }
+
+    // Depth-first walk shared by the whole group. A node is accepted only if
+    // it passes the opening test from the closest point of the group's box,
+    // so it passes for every member. Nodes holding group members are always
+    // opened, and their bodies (the group itself) are summed directly.
+    int stack[OCT_REGIONS * (MAX_DEPTH + 1)];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        int node = stack[--top];
+        int begin = bodyBegin[node];
+        int end = begin + bodyCount[node];
+        if (end <= groupBegin || groupEnd <= begin) {
+            double dx = std::max(0.0, std::max(lx - comX[node], comX[node] - ux)) * xScale;
+            double dy = std::max(0.0, std::max(ly - comY[node], comY[node] - uy)) * yScale;
+            double dz = std::max(0.0, std::max(lz - comZ[node], comZ[node] - uz)) * zScale;
+            double distSq = dx * dx + dy * dy + dz * dz;
+            if (bodyCount[node] == 1 ||
+                opening.accept(mass[node], size[node], bmax[node], distSq, accOld, false)) {
+                // node only has a single body, or is far enough away
+                list.push((real)(comX[node] - this->originX), (real)(comY[node] - this->originY),
+                          (real)(comZ[node] - this->originZ), (real)(mass[node] / this->massUnit));
+                continue;
+            }
+        }
+        if (childCount[node] == 0) {
+            // leaf bucket too close to some member: all its bodies interact directly
+            for (int s = begin; s < end; s++) {
+                list.push(bodies.x[s], bodies.y[s], bodies.z[s], bodies.mass[s]);
+            }
+        } else {
+            // node too close, need to follow all its children
+            int child = childBegin[node];
+            for (int c = child + childCount[node] - 1; c >= child; c--) {
+                stack[top++] = c;
+            }
+        }
+    }
+
+    // Evaluate the shared list against every member, the kernel skips the
+    // member itself (zero distance)
+    int count = (int)list.m.size();
+    for (int s = groupBegin; s < groupEnd; s++) {
+        double acc[3] = {0.0, 0.0, 0.0};
+        accumulateAccel(list.x.data(), list.y.data(), list.z.data(), list.m.data(), count,
+                        bodies.x[s], bodies.y[s], bodies.z[s], acc);
+        double scale = G * bodyMass[s] * this->massUnit;
+        particles.apply(order[s], std::make_tuple(scale * acc[0], scale * acc[1], scale * acc[2]));
+    }
+}
+
+bool
+LinearOctTree::checkParticleBounds(int i) {
+    int node = leafOf[i];
+    double x = particles.x[i], y = particles.y[i], z = particles.z[i];
+    return x < lowerX[node] || x > upperX[node] ||
+           y < lowerY[node] || y > upperY[node] ||
+           z < lowerZ[node] || z > upperZ[node];
+}
+
+void
+LinearOctTree::print() {
+    printRecurse(0);
+}
+
+void
+LinearOctTree::printRecurse(int node) {
+    if (childCount[node] == 0) {
+        int begin = bodyBegin[node];
+        for (int s = begin; s < begin + bodyCount[node]; s++) {
+            std::cout << "Leaf " << particles.id[order[s]] << ": (" << bodyX[s] << ", " <<
+                bodyY[s] << ", " << bodyZ[s] << ")" << std::endl;
+        }
+        return;
+    }
+    std::cout << "Root(" << (lowerX[node] + upperX[node]) / 2 << ", " <<
+        (lowerY[node] + upperY[node]) / 2 << ", " << (lowerZ[node] + upperZ[node]) / 2 <<
+        ") mass: " << mass[node] << " center of mass: (" << comX[node] << ", " <<
+        comY[node] << ", " << comZ[node] << ")" << std::endl;
+    int begin = childBegin[node];
+    for (int c = begin; c < begin + childCount[node]; c++) {
+        printRecurse(c);
+    }
+}
@@ -18,36 +18,22 @@ Root::Root(Node *parent, vector_3d lowerBound, vector_3d upperBound) : Node(pare
     this->upperBound = upperBound;
     this->size = std::get<X>(upperBound) - std::get<X>(lowerBound);
     this->pos = average(lowerBound, upperBound);
-    this->children = new Node *[OCT_REGIONS];
     for (int i = 0; i < OCT_REGIONS; ++i) {
         this->children[i] = nullptr;
     }
     this->numChildren = 0;
     this->mass = 0;
+    this->bmax = 0;
     this->centerOfMass = zero_vect();
-}
-
-Root::~Root() {
-    // Free dynamic memory owned by Root node
-    for (int i=0; i < OCT_REGIONS; ++i) {
-        Node *child = children[i];
-        if (child == nullptr) {
-            continue;
-        }
-        // Delete Root nodes. Memory for Leaf nodes is owned by main program
-        if (child->isLeaf()) {
-            child->octet = 0;
-            child->parent = nullptr;
-        } else {
-            delete child;
-        }
+    for (int i = 0; i < 6; ++i) {
+        this->quadrupole[i] = 0;
     }
-    // Delete memory allocated for children array
-    delete []this->children;
 }
 
 Leaf::Leaf(Node *parent, Body &&body) : Node(parent) {
     this->body = body;
+    this->overflow = false;
+    this->index = -1;
 }
 
 /* Calculate the distance between this and leaf */
@@ -86,6 +72,30 @@ Leaf::rootForce(Root *root, double dist) {
     return f;
 }
 
+/* Calculate force vector produced on this by root's quadrupole moment */
+vector_3d
+Leaf::rootQuadrupoleForce(Root *root, double dist) {
+    vector_3d f = zero_vect();
+    if (dist != 0) {
+        // a = G * (Q r / d^5 - 5/2 * (r^T Q r) r / d^7), r from center of mass to body
+        const double *q = root->quadrupole;
+        double x = (std::get<X>(this->body.pos) - std::get<X>(root->centerOfMass)) * xScale;
+        double y = (std::get<Y>(this->body.pos) - std::get<Y>(root->centerOfMass)) * yScale;
+        double z = (std::get<Z>(this->body.pos) - std::get<Z>(root->centerOfMass)) * zScale;
+        double qx = q[XX] * x + q[XY] * y + q[XZ] * z;
+        double qy = q[XY] * x + q[YY] * y + q[YZ] * z;
+        double qz = q[XZ] * x + q[YZ] * y + q[ZZ] * z;
+        double inv2 = 1.0 / (dist * dist);
+        double inv5 = inv2 * inv2 / dist;
+        double radial = 2.5 * (x * qx + y * qy + z * qz) * inv2;
+        double mag = G * this->body.mass * inv5;
+        std::get<X>(f) = (qx - radial * x) * mag;
+        std::get<Y>(f) = (qy - radial * y) * mag;
+        std::get<Z>(f) = (qz - radial * z) * mag;
+    }
+    return f;
+}
+
 /* Override "<<" operator for printing Root details to I/O output stream */
 std::ostream& operator<<(std::ostream& out, const Root& r) {
     out << "Root(" << std::get<X>(r.pos) << ", " << std::get<Y>(r.pos) << ", " <<
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: NodeArena.cpp
+ */
+
+#include <new>
+#include "NodeArena.h"
+
+NodeArena::NodeArena(int numPools) : pools(numPools) {
+    for (Pool &pool : this->pools) {
+        pool.chunk = 0;
+        pool.used = 0;
+        pool.inUse = 0;
+    }
+}
+
+// Free every chunk. Root nodes hold no owned memory, so no destructors run.
+NodeArena::~NodeArena() {
+    for (Pool &pool : this->pools) {
+        for (Root *chunk : pool.chunks) {
+            ::operator delete(chunk);
+        }
+    }
+}
+
+Root *
+NodeArena::allocRoot(int pool, Node *parent, vector_3d lowerBound, vector_3d upperBound) {
+    Pool &p = this->pools[pool];
+    Root *root;
+    if (!p.freeList.empty()) {
+        // Reuse a recycled node
+        root = p.freeList.back();
+        p.freeList.pop_back();
+    } else {
+        // Move to the next chunk once the current one is exhausted
+        if (p.used == ARENA_CHUNK_NODES) {
+            p.chunk += 1;
+            p.used = 0;
+        }
+        if (p.chunk == (int)p.chunks.size()) {
+            p.chunks.push_back(static_cast<Root *>(
+                    ::operator new(sizeof(Root) * ARENA_CHUNK_NODES)));
+        }
+        root = p.chunks[p.chunk] + p.used;
+        p.used += 1;
+    }
+    p.inUse += 1;
+    return new (root) Root(parent, lowerBound, upperBound);
+}
+
+void
+NodeArena::freeRoot(int pool, Root *root) {
+    Pool &p = this->pools[pool];
+    root->~Root();
+    p.freeList.push_back(root);
+    p.inUse -= 1;
+}
+
+void
+NodeArena::reset() {
+    for (Pool &pool : this->pools) {
+        pool.freeList.clear();
+        pool.chunk = 0;
+        pool.used = 0;
+        pool.inUse = 0;
+    }
+}
+
+long long
+NodeArena::nodesInUse() {
+    long long total = 0;
+    for (Pool &pool : this->pools) {
+        total += pool.inUse;
+    }
+    return total;
+}
+
+size_t
+NodeArena::bytesReserved() {
+    size_t total = 0;
+    for (Pool &pool : this->pools) {
+        total += pool.chunks.size() * sizeof(Root) * ARENA_CHUNK_NODES;
+    }
+    return total;
+}
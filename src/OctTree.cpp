@@ -4,207 +4,310 @@
  * BarnesHutSimulation: OctTree.cpp
  */
 
+#include <algorithm>
 #include <assert.h>
 #include <iostream>
-#include <map>
-#include <thread>
 #include <vector>
 #include "OctTree.h"
+#include "Parallel.h"
 
+// Octets number the x/y quadrants counterclockwise from upper x and upper y
+// (0 to 3). In 3D each quadrant is split again, upper z first, so octet is
+// 2 * quadrant + (z below center).
 static std::pair<vector_3d, vector_3d> getBounds(Root *root, int octet) {
-    vector_3d lowerBound;
-    vector_3d upperBound;
-    double x, y, z;
+    int quadrant = DIMENSIONS == 3 ? octet >> 1 : octet;
+    bool upperX = quadrant == 0 || quadrant == 3;
+    bool upperY = quadrant <= 1;
+    bool upperZ = DIMENSIONS == 3 && (octet & 1) == 0;
 
     // Return bounds for new root node within octet
-    if (octet == 0) {
-        x = std::get<X>(root->pos);
-        y = std::get<Y>(root->pos);
-        z = std::get<Z>(root->pos);
-        lowerBound = std::make_tuple(x, y, z);
-        x = std::get<X>(root->upperBound);
-        y = std::get<Y>(root->upperBound);
-        z = std::get<Z>(root->upperBound);
-        upperBound = std::make_tuple(x, y, z);
-    } else if (octet == 1) {
-        x = std::get<X>(root->pos);
-        y = std::get<Y>(root->pos);
-        z = std::get<Z>(root->lowerBound);
-        lowerBound = std::make_tuple(x, y, z);
-        x = std::get<X>(root->upperBound);
-        y = std::get<Y>(root->upperBound);
-        z = std::get<Z>(root->pos);
-        upperBound = std::make_tuple(x, y, z);
-    } else if (octet == 2) {
-        x = std::get<X>(root->lowerBound);
-        y = std::get<Y>(root->pos);
-        z = std::get<Z>(root->pos);
-        lowerBound = std::make_tuple(x, y, z);
-        x = std::get<X>(root->pos);
-        y = std::get<Y>(root->upperBound);
-        z = std::get<Z>(root->upperBound);
-        upperBound = std::make_tuple(x, y, z);
-    } else if (octet == 3) {
-        x = std::get<X>(root->lowerBound);
-        y = std::get<Y>(root->pos);
-        z = std::get<Z>(root->lowerBound);
-        lowerBound = std::make_tuple(x, y, z);
-        x = std::get<X>(root->pos);
-        y = std::get<Y>(root->upperBound);
-        z = std::get<Z>(root->pos);
-        upperBound = std::make_tuple(x, y, z);
-    } else if (octet == 4) {
-        x = std::get<X>(root->lowerBound);
-        y = std::get<Y>(root->lowerBound);
-        z = std::get<Z>(root->pos);
-        lowerBound = std::make_tuple(x, y, z);
-        x = std::get<X>(root->pos);
-        y = std::get<Y>(root->pos);
-        z = std::get<Z>(root->upperBound);
-        upperBound = std::make_tuple(x, y, z);
-    } else if (octet == 5) {
-        x = std::get<X>(root->lowerBound);
-        y = std::get<Y>(root->lowerBound);
-        z = std::get<Z>(root->lowerBound);
-        lowerBound = std::make_tuple(x, y, z);
-        x = std::get<X>(root->pos);
-        y = std::get<Y>(root->pos);
-        z = std::get<Z>(root->pos);
-        upperBound = std::make_tuple(x, y, z);
-    } else if (octet == 6) {
-        x = std::get<X>(root->pos);
-        y = std::get<Y>(root->lowerBound);
-        z = std::get<Z>(root->pos);
-        lowerBound = std::make_tuple(x, y, z);
-        x = std::get<X>(root->upperBound);
-        y = std::get<Y>(root->pos);
-        z = std::get<Z>(root->upperBound);
-        upperBound = std::make_tuple(x, y, z);
-    } else if (octet == 7) {
-        x = std::get<X>(root->pos);
-        y = std::get<Y>(root->lowerBound);
-        z = std::get<Z>(root->lowerBound);
-        lowerBound = std::make_tuple(x, y, z);
-        x = std::get<X>(root->upperBound);
-        y = std::get<Y>(root->pos);
-        z = std::get<Z>(root->pos);
-        upperBound = std::make_tuple(x, y, z);
-    }
-    return std::pair<vector_3d, vector_3d>(lowerBound, upperBound);
+    double lx = upperX ? std::get<X>(root->pos) : std::get<X>(root->lowerBound);
+    double ux = upperX ? std::get<X>(root->upperBound) : std::get<X>(root->pos);
+    double ly = upperY ? std::get<Y>(root->pos) : std::get<Y>(root->lowerBound);
+    double uy = upperY ? std::get<Y>(root->upperBound) : std::get<Y>(root->pos);
+    double lz = std::get<Z>(root->lowerBound);
+    double uz = std::get<Z>(root->upperBound);
+    if (DIMENSIONS == 3) {
+        lz = upperZ ? std::get<Z>(root->pos) : lz;
+        uz = upperZ ? uz : std::get<Z>(root->pos);
+    }
+    return std::pair<vector_3d, vector_3d>(std::make_tuple(lx, ly, lz),
+                                           std::make_tuple(ux, uy, uz));
 }
 
 int
 OctTree::findOctet(const vector_3d &rootPos, const vector_3d &bodyPos) {
-    double rootX = std::get<X>(rootPos);
-    double rootY = std::get<Y>(rootPos);
-    double rootZ = std::get<Z>(rootPos);
-    double particleX = std::get<X>(bodyPos);
-    double particleY = std::get<Y>(bodyPos);
-    double particleZ = std::get<Z>(bodyPos);
-
-    if( particleX >= rootX && particleY >= rootY && particleZ >= rootZ ) {
-        return 0;
-    } else if( particleX >= rootX && particleY >= rootY && particleZ < rootZ ) {
-        return 1;
-    } else if( particleX < rootX && particleY >= rootY && particleZ >= rootZ ) {
-        return 2;
-    } else if( particleX < rootX && particleY >= rootY && particleZ < rootZ ) {
-        return 3;
-    } else if( particleX < rootX && particleY < rootY && particleZ >= rootZ ) {
-        return 4;
-    } else if( particleX < rootX && particleY < rootY && particleZ < rootZ ) {
-        return 5;
-    } else if( particleX >= rootX && particleY < rootY && particleZ >= rootZ ) {
-        return 6;
-    } else if( particleX >= rootX && particleY < rootY && particleZ < rootZ ) {
-        return 7;
-    } else {
-        assert(false && "cannot determine octet");
+    bool upperX = std::get<X>(bodyPos) >= std::get<X>(rootPos);
+    bool upperY = std::get<Y>(bodyPos) >= std::get<Y>(rootPos);
+    int quadrant = upperY ? (upperX ? 0 : 1) : (upperX ? 3 : 2);
+    if (DIMENSIONS == 2) {
+        return quadrant;
     }
+    return 2 * quadrant + (std::get<Z>(bodyPos) < std::get<Z>(rootPos));
+}
+
+/* Largest distance from pos to a corner of the bounds */
+static double farthestCorner(const vector_3d &pos, const vector_3d &lowerBound,
+                             const vector_3d &upperBound) {
+    double dx = std::max(std::get<X>(pos) - std::get<X>(lowerBound),
+                         std::get<X>(upperBound) - std::get<X>(pos)) * xScale;
+    double dy = std::max(std::get<Y>(pos) - std::get<Y>(lowerBound),
+                         std::get<Y>(upperBound) - std::get<Y>(pos)) * yScale;
+    double dz = std::max(std::get<Z>(pos) - std::get<Z>(lowerBound),
+                         std::get<Z>(upperBound) - std::get<Z>(pos)) * zScale;
+    return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+/* Squared distance from pos to the nearest point within the given bounds */
+static double nearestPointSq(const vector_3d &pos, const vector_3d &lowerBound,
+                             const vector_3d &upperBound) {
+    double dx = (std::get<X>(pos) - std::max(std::get<X>(lowerBound),
+                 std::min(std::get<X>(upperBound), std::get<X>(pos)))) * xScale;
+    double dy = (std::get<Y>(pos) - std::max(std::get<Y>(lowerBound),
+                 std::min(std::get<Y>(upperBound), std::get<Y>(pos)))) * yScale;
+    double dz = (std::get<Z>(pos) - std::max(std::get<Z>(lowerBound),
+                 std::min(std::get<Z>(upperBound), std::get<Z>(pos)))) * zScale;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+/* Is pos outside the bounds of root? */
+static bool outsideBounds(Root *root, const vector_3d &pos) {
+    return std::get<X>(pos) < std::get<X>(root->lowerBound) ||
+           std::get<Y>(pos) < std::get<Y>(root->lowerBound) ||
+           std::get<Z>(pos) < std::get<Z>(root->lowerBound) ||
+           std::get<X>(pos) > std::get<X>(root->upperBound) ||
+           std::get<Y>(pos) > std::get<Y>(root->upperBound) ||
+           std::get<Z>(pos) > std::get<Z>(root->upperBound);
+}
+
+/* First empty octet of root, or -1 if every octet is taken */
+static int freeOctet(Root *root) {
+    for (int i = 0; i < OCT_REGIONS; i++) {
+        if (root->children[i] == nullptr) {
+            return i;
+        }
+    }
+    return -1;
 }
 
 /* Construct OctTree given list of particles */
 OctTree::OctTree(std::vector<Leaf *> &particles, vector_3d lowerBound,
-                 vector_3d upperBound) {
+                 vector_3d upperBound, NodeArena *arena) {
+    // Allocate Root nodes from the given arena, or from one owned by the tree
+    this->ownsArena = arena == nullptr;
+    this->arena = this->ownsArena ? new NodeArena(arenaPools()) : arena;
+    this->lowerBound = lowerBound;
+    this->upperBound = upperBound;
+
     // Construct root of the tree
-    this->root = new Root(nullptr, lowerBound, upperBound);
+    this->root = this->arena->allocRoot(SERIAL_POOL, nullptr, lowerBound, upperBound);
 
     // Cache whether class functions should use multiple threads
     this->parallel = NULL == std::getenv("SEQ");
+    this->quadrupole = NULL != std::getenv("QUADRUPOLE");
 
     // Insert particles into tree
     insertParticles(particles);
 }
 
-// Destroy OctTree by freeing memory allocated for root
+// Destroy OctTree. Root nodes live in the arena and are released with it.
 OctTree::~OctTree() {
-    delete root;
+    if (this->ownsArena) {
+        delete this->arena;
+    }
+}
+
+void
+OctTree::rebuild(std::vector<Leaf *> &particles) {
+    if (outsideParallel()) {
+        #pragma omp parallel if(this->parallel)
+        rebuild(particles);
+        return;
+    }
+    // Start again from the initial bounds so that the root only grows as far
+    // as the current particles require
+    #pragma omp single
+    {
+        this->arena->reset();
+        this->root = this->arena->allocRoot(SERIAL_POOL, nullptr, this->lowerBound,
+                                            this->upperBound);
+    }
+    insertParticles(particles);
+}
+
+void
+OctTree::growRoot(const vector_3d &pos) {
+    while (outsideBounds(this->root, pos)) {
+        // Double the root along every axis, towards pos where it lies below
+        Root *oldRoot = this->root;
+        vector_3d lower = oldRoot->lowerBound;
+        vector_3d upper = oldRoot->upperBound;
+        double dx = std::get<X>(upper) - std::get<X>(lower);
+        double dy = std::get<Y>(upper) - std::get<Y>(lower);
+        double dz = std::get<Z>(upper) - std::get<Z>(lower);
+        if (std::get<X>(pos) < std::get<X>(lower)) {
+            std::get<X>(lower) -= dx;
+        } else {
+            std::get<X>(upper) += dx;
+        }
+        if (std::get<Y>(pos) < std::get<Y>(lower)) {
+            std::get<Y>(lower) -= dy;
+        } else {
+            std::get<Y>(upper) += dy;
+        }
+        if (std::get<Z>(pos) < std::get<Z>(lower)) {
+            std::get<Z>(lower) -= dz;
+        } else {
+            std::get<Z>(upper) += dz;
+        }
+        Root *newRoot = this->arena->allocRoot(SERIAL_POOL, nullptr, lower, upper);
+
+        // Old root becomes the child occupying its corner of the new root
+        if (oldRoot->numChildren == 0) {
+            this->arena->freeRoot(SERIAL_POOL, oldRoot);
+        } else {
+            int octet = findOctet(newRoot->pos, oldRoot->pos);
+            newRoot->children[octet] = oldRoot;
+            newRoot->numChildren = 1;
+            oldRoot->parent = newRoot;
+            oldRoot->octet = octet;
+        }
+        this->root = newRoot;
+    }
+}
+
+void
+OctTree::growRootToFit(std::vector<Leaf *> &particles) {
+    // Find bounding box of particles across the team: each thread merges the
+    // bounds of its share into fitLower and fitUpper
+    int n = (int)particles.size();
+    if (n == 0) {
+        return;
+    }
+    #pragma omp single
+    {
+        this->fitLower = this->root->pos;
+        this->fitUpper = this->root->pos;
+    }
+    double minX = std::get<X>(this->root->pos), maxX = minX;
+    double minY = std::get<Y>(this->root->pos), maxY = minY;
+    double minZ = std::get<Z>(this->root->pos), maxZ = minZ;
+    #pragma omp for nowait
+    for (int i = 0; i < n; i++) {
+        const vector_3d &pos = particles[i]->body.pos;
+        minX = std::min(minX, std::get<X>(pos));
+        minY = std::min(minY, std::get<Y>(pos));
+        minZ = std::min(minZ, std::get<Z>(pos));
+        maxX = std::max(maxX, std::get<X>(pos));
+        maxY = std::max(maxY, std::get<Y>(pos));
+        maxZ = std::max(maxZ, std::get<Z>(pos));
+    }
+    #pragma omp critical
+    {
+        std::get<X>(this->fitLower) = std::min(std::get<X>(this->fitLower), minX);
+        std::get<Y>(this->fitLower) = std::min(std::get<Y>(this->fitLower), minY);
+        std::get<Z>(this->fitLower) = std::min(std::get<Z>(this->fitLower), minZ);
+        std::get<X>(this->fitUpper) = std::max(std::get<X>(this->fitUpper), maxX);
+        std::get<Y>(this->fitUpper) = std::max(std::get<Y>(this->fitUpper), maxY);
+        std::get<Z>(this->fitUpper) = std::max(std::get<Z>(this->fitUpper), maxZ);
+    }
+    #pragma omp barrier
+    #pragma omp single
+    {
+        growRoot(this->fitLower);
+        growRoot(this->fitUpper);
+    }
 }
 
 // Insert particle into tree
 void
 OctTree::insert(Leaf *particle) {
+    growRoot(particle->body.pos);
     int octet = findOctet(this->root->pos, particle->body.pos);
-    insertParticle(this->root, particle, octet);
+    insertParticle(this->root, particle, octet, SERIAL_POOL);
 }
 
-// Insert new particle into tree rooted at root
+// Insert new particle into tree rooted at root, allocating from arena pool.
+// From MAX_TREE_DEPTH on, a particle whose octet is taken goes into any free
+// octet of the cell as an overflow leaf, and the cell is only split further
+// once all of its octets are taken. So the tree is no deeper than
+// MAX_TREE_DEPTH (counted from the root at the time of insertion) unless
+// more than OCT_REGIONS particles cannot be separated, e.g. share a position.
 void
-OctTree::insertParticle(Root *root, Leaf *particle, const int octet) {
-    Node *child = root->children[octet];
+OctTree::insertParticle(Root *root, Leaf *particle, const int octet, const int pool) {
+    int target = octet;
+    bool overflow = false;
+    for (int depth = 0; ; depth++) {
+        Node *child = root->children[target];
+        if (child != nullptr && depth >= MAX_TREE_DEPTH && freeOctet(root) != -1) {
+            target = freeOctet(root);
+            child = nullptr;
+            overflow = true;
+        }
 
-    // If octet is empty, insert leaf at octet
-    if (child == nullptr) {
-        root->children[octet] = particle;
-        root->numChildren += 1;
-        particle->octet = octet;
-        particle->parent = root;
-    } else if (child->isLeaf()) {
-        // If child is a leaf, construct a new subtree and re-insert child
-        // along with particle.
-        std::pair<vector_3d, vector_3d> bounds = getBounds(root, octet);
-        Root *newRoot = new Root(root, bounds.first, bounds.second);
-        newRoot->octet = octet;
-        root->children[octet] = newRoot;
-        Leaf *leaf = (Leaf *)child;
-        insertParticle(newRoot, leaf,
-                findOctet(newRoot->pos, leaf->body.pos));
-        insertParticle(newRoot, particle,
-                findOctet(newRoot->pos, particle->body.pos));
-    } else {
-        // Continue down tree
-        Root *newRoot = (Root *)child;
-        insertParticle(newRoot, particle,
-                findOctet(newRoot->pos, particle->body.pos));
+        if (child == nullptr) {
+            // If octet is empty, insert leaf at octet
+            root->children[target] = particle;
+            root->numChildren += 1;
+            particle->octet = target;
+            particle->parent = root;
+            particle->overflow = overflow;
+            return;
+        } else if (child->isLeaf()) {
+            // If child is a leaf, construct a new subtree holding the child,
+            // then continue inserting particle into it. An overflow leaf lies
+            // elsewhere in root, so its subtree covers all of root.
+            Leaf *leaf = (Leaf *)child;
+            std::pair<vector_3d, vector_3d> bounds = leaf->overflow ?
+                std::make_pair(root->lowerBound, root->upperBound) : getBounds(root, target);
+            Root *newRoot = this->arena->allocRoot(pool, root, bounds.first, bounds.second);
+            newRoot->octet = target;
+            root->children[target] = newRoot;
+            int leafOctet = findOctet(newRoot->pos, leaf->body.pos);
+            newRoot->children[leafOctet] = leaf;
+            newRoot->numChildren = 1;
+            leaf->octet = leafOctet;
+            leaf->parent = newRoot;
+            leaf->overflow = false;
+            root = newRoot;
+        } else {
+            // Continue down tree
+            root = (Root *)child;
+        }
+        target = findOctet(root->pos, particle->body.pos);
     }
 }
 
 // Insert particles into OctTree in parallel
 void
 OctTree::insertParticles(std::vector<Leaf *> &particles) {
-    std::map<int, std::thread> threadPool;
-    for (Leaf *particle : particles) {
-        // Determine octet for particle (0-7)
-        int octet = findOctet(this->root->pos, particle->body.pos);
-        // Insert particle into tree sequentially or using std::thread
-        if (this->parallel) {
-            // If existing thread is already executing on octet, wait for it to complete.
-            std::map<int, std::thread>::iterator it = threadPool.find(octet);
-            if (it != threadPool.end()) {
-                it->second.join();
-            }
-            threadPool[octet] =
-                std::thread(&OctTree::insertParticle, this, this->root, particle, octet);
-        } else {
-            insertParticle(this->root, particle, octet);
-        }
+    if (outsideParallel()) {
+        #pragma omp parallel if(this->parallel)
+        insertParticles(particles);
+        return;
     }
-    if (this->parallel) {
-        // Wait for all in-flight insertions to complete.
-        std::map<int, std::thread>::iterator it;
-        for (it = threadPool.begin(); it != threadPool.end(); ++it) {
-            it->second.join();
+    growRootToFit(particles);
+
+    #pragma omp single
+    {
+        // Group particles by octet (0 to OCT_REGIONS - 1), keeping their order
+        std::vector<Leaf *> octets[OCT_REGIONS];
+        for (Leaf *particle : particles) {
+            octets[findOctet(this->root->pos, particle->body.pos)].push_back(particle);
         }
+
+        // Build each octet in its own task, on the (pinned) OpenMP team. Each
+        // octet is only ever built by one task, so it owns that arena pool.
+        for (int octet = 0; octet < OCT_REGIONS; octet++) {
+            if (octets[octet].empty()) {
+                continue;
+            }
+            #pragma omp task shared(octets) if(this->parallel)
+            for (Leaf *particle : octets[octet]) {
+                insertParticle(this->root, particle, octet, octet);
+            }
+        }
+        #pragma omp taskwait
     }
 }
 
@@ -228,18 +331,16 @@ OctTree::maybeReplaceRoot(Root *root) {
         Root *parent = (Root *)root->parent;
         parent->children[root->octet] = nullptr;
         parent->numChildren -= 1;
-        delete root;
+        this->arena->freeRoot(SERIAL_POOL, root);
         // Recurse on parent
         maybeReplaceRoot(parent);
-    } else if (root->numChildren == 1) {
+    } else if (root->numChildren == 1 && root != this->root) {
         // If root has only one child, and that child is a Leaf, replace root
         Leaf *leaf = nullptr;
-        for (int i=0; i < 8; ++i) {
+        for (int i=0; i < OCT_REGIONS; ++i) {
             Node *node = root->children[i];
             if (node != nullptr && node->isLeaf()) {
                 leaf = (Leaf *)node;
-                // Clear root pointer to leaf so that it does not try to delete it
-                // in Root destructor.
                 root->children[i] = nullptr;
                 break;
             }
@@ -251,35 +352,201 @@ OctTree::maybeReplaceRoot(Root *root) {
             parent->children[octet] = leaf;
             leaf->parent = parent;
             leaf->octet = octet;
-            delete root;
+            leaf->overflow = findOctet(parent->pos, leaf->body.pos) != octet;
+            this->arena->freeRoot(SERIAL_POOL, root);
             // Recurse on parent
             maybeReplaceRoot(parent);
         }
     }
 }
 
+// Remove moved particles and re-insert them from the top of the tree
 void
-OctTree::setCenterOfMass() {
-    // Calculate center of mass for each Root node through recursion
-    #pragma omp parallel
-    {
+OctTree::reinsertParticles(std::vector<Leaf *> &moved) {
+    if (outsideParallel()) {
+        #pragma omp parallel if(this->parallel)
+        reinsertParticles(moved);
+        return;
+    }
+    int numMoved = (int)moved.size();
+    if (!this->parallel) {
         #pragma omp single
-        centerOfMass(this->root);
+        for (Leaf *particle : moved) {
+            remove(particle);
+            insert(particle);
+        }
+        return;
+    }
+    if (numMoved == 0) {
+        return;
     }
+
+    // Detach every moved particle. Each slot holds a single particle, so
+    // threads never write the same slot. Counts are fixed up by prune.
+    #pragma omp for
+    for (int j = 0; j < numMoved; j++) {
+        Leaf *particle = moved[j];
+        Root *parent = (Root *)particle->parent;
+        parent->children[particle->octet] = nullptr;
+        particle->parent = nullptr;
+    }
+
+    // Grow root to hold particles that left the bounds, then insert concurrently
+    growRootToFit(moved);
+    #pragma omp for schedule(dynamic, 64)
+    for (int j = 0; j < numMoved; j++) {
+        insertConcurrent(moved[j]);
+    }
+
+    // Every thread is done, so collapsed Root nodes can be safely reclaimed
+    #pragma omp single
+    prune(this->root);
 }
 
+// Insert particle with compare-and-swap on child slots. A Leaf is split by
+// publishing a new Root that already holds it, so readers never observe a
+// partially built subtree. Parent links and overflow flags are left for prune
+// to repair.
 void
-OctTree::centerOfMass(Root *root) {
-    // Spawn task for each Root node and wait for tasks to complete
+OctTree::insertConcurrent(Leaf *particle) {
+    Root *root = this->root;
+    for (int depth = 0; ; ) {
+        int octet = findOctet(root->pos, particle->body.pos);
+        Node **slot = &root->children[octet];
+        Node *child = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        if (child != nullptr && depth >= MAX_TREE_DEPTH) {
+            // Too deep to split: take any free octet if one is left
+            for (int i = 0; i < OCT_REGIONS; i++) {
+                Node *expected = nullptr;
+                if (__atomic_compare_exchange_n(&root->children[i], &expected, (Node *)particle,
+                                                false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                    return;
+                }
+            }
+        }
+        if (child == nullptr) {
+            // Claim empty slot
+            if (__atomic_compare_exchange_n(slot, &child, (Node *)particle, false,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                return;
+            }
+        } else if (child->isLeaf()) {
+            // Replace leaf with a private subtree holding it, then descend. A
+            // leaf outside octet was placed there as overflow, so the subtree
+            // covers all of root.
+            Leaf *leaf = (Leaf *)child;
+            std::pair<vector_3d, vector_3d> bounds =
+                findOctet(root->pos, leaf->body.pos) != octet ?
+                std::make_pair(root->lowerBound, root->upperBound) : getBounds(root, octet);
+            Root *newRoot = this->arena->allocRoot(threadPool(), root,
+                                                   bounds.first, bounds.second);
+            newRoot->octet = octet;
+            newRoot->children[findOctet(newRoot->pos, leaf->body.pos)] = leaf;
+            newRoot->numChildren = 1;
+            if (__atomic_compare_exchange_n(slot, &child, (Node *)newRoot, false,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                root = newRoot;
+                depth++;
+            } else {
+                // Lost the race; newRoot was never visible to other threads
+                this->arena->freeRoot(threadPool(), newRoot);
+            }
+        } else {
+            // Continue down tree
+            root = (Root *)child;
+            depth++;
+        }
+    }
+}
+
+// Recount children, repair parent links, and collapse Root nodes that are
+// empty or hold a single Leaf, matching what maybeReplaceRoot would produce.
+void
+OctTree::prune(Root *root) {
     for (int i=0; i < OCT_REGIONS; i++) {
         Node *child = root->children[i];
         if (child != nullptr && !child->isLeaf()) {
             #pragma omp task
-            centerOfMass((Root *)child);
+            prune((Root *)child);
         }
     }
     #pragma omp taskwait
 
+    root->numChildren = 0;
+    for (int i=0; i < OCT_REGIONS; i++) {
+        Node *child = root->children[i];
+        if (child == nullptr) {
+            continue;
+        }
+        if (!child->isLeaf()) {
+            Root *rootChild = (Root *)child;
+            Node *only = nullptr;
+            for (int k=0; k < OCT_REGIONS; k++) {
+                if (rootChild->children[k] != nullptr) {
+                    only = rootChild->children[k];
+                }
+            }
+            if (rootChild->numChildren == 0) {
+                root->children[i] = nullptr;
+                this->arena->freeRoot(threadPool(), rootChild);
+                continue;
+            } else if (rootChild->numChildren == 1 && only->isLeaf()) {
+                root->children[i] = only;
+                this->arena->freeRoot(threadPool(), rootChild);
+                child = only;
+            }
+        }
+        child->parent = root;
+        child->octet = i;
+        if (child->isLeaf()) {
+            Leaf *leaf = (Leaf *)child;
+            leaf->overflow = findOctet(root->pos, leaf->body.pos) != i;
+        }
+        root->numChildren += 1;
+    }
+}
+
+void
+OctTree::setCenterOfMass() {
+    if (outsideParallel()) {
+        #pragma omp parallel if(this->parallel)
+        setCenterOfMass();
+        return;
+    }
+    // Spawn tasks down to the level that holds a few subtrees per thread
+    int taskLevels = 0;
+    if (this->parallel) {
+        int threads = omp_get_num_threads();
+        for (long tasks = 1; tasks < (long)COM_TASKS_PER_THREAD * threads; tasks *= OCT_REGIONS) {
+            taskLevels++;
+        }
+    }
+
+    // Calculate center of mass for each Root node through recursion
+    #pragma omp single
+    centerOfMass(this->root, taskLevels);
+}
+
+void
+OctTree::centerOfMass(Root *root, int taskLevels) {
+    // Spawn task for each Root node near the top and wait for tasks to complete,
+    // below that recurse serially
+    for (int i=0; i < OCT_REGIONS; i++) {
+        Node *child = root->children[i];
+        if (child == nullptr || child->isLeaf()) {
+            continue;
+        }
+        if (taskLevels > 0) {
+            #pragma omp task
+            centerOfMass((Root *)child, taskLevels - 1);
+        } else {
+            centerOfMass((Root *)child, 0);
+        }
+    }
+    if (taskLevels > 0) {
+        #pragma omp taskwait
+    }
+
     // Set center of mass for node
     double x = 0.0, y = 0.0, z = 0.0;
     root->mass = 0.0;
@@ -303,33 +570,89 @@ OctTree::centerOfMass(Root *root) {
     }
     // Update center of mass
     root->centerOfMass = std::make_tuple(x / root->mass, y / root->mass, z / root->mass);
+    root->bmax = farthestCorner(root->centerOfMass, root->lowerBound, root->upperBound);
+    if (!this->quadrupole) {
+        return;
+    }
+
+    // Shift each child's moment to this center of mass (parallel axis
+    // theorem): Q += Q_child + m * (3 d d^T - |d|^2 I)
+    double *q = root->quadrupole;
+    for (int k = 0; k < 6; k++) {
+        q[k] = 0.0;
+    }
+    for (int i=0; i < OCT_REGIONS; i++) {
+        Node *child = root->children[i];
+        if (child == nullptr) {
+            continue;
+        }
+        double m;
+        vector_3d pos;
+        if (child->isLeaf()) {
+            m = ((Leaf *)child)->body.mass;
+            pos = ((Leaf *)child)->body.pos;
+        } else {
+            Root *rootChild = (Root *)child;
+            m = rootChild->mass;
+            pos = rootChild->centerOfMass;
+            for (int k = 0; k < 6; k++) {
+                q[k] += rootChild->quadrupole[k];
+            }
+        }
+        double dx = (std::get<X>(pos) - std::get<X>(root->centerOfMass)) * xScale;
+        double dy = (std::get<Y>(pos) - std::get<Y>(root->centerOfMass)) * yScale;
+        double dz = (std::get<Z>(pos) - std::get<Z>(root->centerOfMass)) * zScale;
+        double distSq = dx * dx + dy * dy + dz * dz;
+        q[XX] += m * (3 * dx * dx - distSq);
+        q[XY] += m * 3 * dx * dy;
+        q[XZ] += m * 3 * dx * dz;
+        q[YY] += m * (3 * dy * dy - distSq);
+        q[YZ] += m * 3 * dy * dz;
+        q[ZZ] += m * (3 * dz * dz - distSq);
+    }
 }
 
 vector_3d
-OctTree::treeForce(Leaf *particle) {
-    return partialTreeForce(particle, (Node *)this->root);
+OctTree::treeForce(Leaf *particle, int *interactions) {
+    return partialTreeForce(particle, (Node *)this->root, interactions);
 }
 
 vector_3d
-OctTree::partialTreeForce(Leaf *particle, Node *node) {
+OctTree::partialTreeForce(Leaf *particle, Node *node, int *interactions) {
     if (particle == nullptr || node == nullptr) {
         return zero_vect();
     }
     if (node->isLeaf()) {
         // if node is a leaf, return force produced on particle by leaf's body
         Leaf *leaf = (Leaf *)node;
+        if (interactions != nullptr) {
+            *interactions += 1;
+        }
         return particle->body.force(leaf->body);
     } else {
         Root *root = (Root *)node;
         double dist = particle->rootDistance(root);
-        if (root->numChildren == 1 || root->size / dist < THETA) {
-            // root only has a single child or is far enough away
-            return particle->rootForce(root, dist);
+        bool contains = this->opening.criterion == RELATIVE &&
+                        !outsideBounds(root, particle->body.pos);
+        if (this->opening.accept(root->mass, root->size, root->bmax, dist * dist,
+                                 particle->body.accMag, contains)) {
+            // root is far enough away
+            if (interactions != nullptr) {
+                *interactions += 1;
+            }
+            vector_3d f = particle->rootForce(root, dist);
+            if (this->quadrupole) {
+                vector_3d q = particle->rootQuadrupoleForce(root, dist);
+                std::get<X>(f) += std::get<X>(q);
+                std::get<Y>(f) += std::get<Y>(q);
+                std::get<Z>(f) += std::get<Z>(q);
+            }
+            return f;
         } else {
             // root too close, need to follow all its children
             vector_3d f = zero_vect();
             for (int i = 0; i < OCT_REGIONS; ++i) {
-                vector_3d temp = partialTreeForce(particle, root->children[i]);
+                vector_3d temp = partialTreeForce(particle, root->children[i], interactions);
                 std::get<X>(f) += std::get<X>(temp);
                 std::get<Y>(f) += std::get<Y>(temp);
                 std::get<Z>(f) += std::get<Z>(temp);
@@ -339,18 +662,182 @@ OctTree::partialTreeForce(Leaf *particle, Node *node) {
     }
 }
 
+void
+OctTree::essentialBodies(const vector_3d &lower, const vector_3d &upper,
+                         std::vector<double> &masses) {
+    if (outsideParallel()) {
+        #pragma omp parallel if(this->parallel)
+        essentialBodies(lower, upper, masses);
+        return;
+    }
+
+    // Below an opened root, each top-level octet is walked by its own task,
+    // then appended to masses in octet order
+    #pragma omp single
+    {
+        for (int octet = 0; octet < OCT_REGIONS; octet++) {
+            this->octetMasses[octet].clear();
+        }
+        if (essentialNode(this->root, lower, upper, masses)) {
+            for (int octet = 0; octet < OCT_REGIONS; octet++) {
+                #pragma omp task if(this->parallel)
+                essentialRecurse(this->root->children[octet], lower, upper,
+                                 this->octetMasses[octet]);
+            }
+            #pragma omp taskwait
+        }
+        size_t total = masses.size();
+        for (int octet = 0; octet < OCT_REGIONS; octet++) {
+            total += this->octetMasses[octet].size();
+        }
+        masses.resize(total);
+    }
+    #pragma omp for
+    for (int octet = 0; octet < OCT_REGIONS; octet++) {
+        size_t offset = masses.size();
+        for (int after = octet; after < OCT_REGIONS; after++) {
+            offset -= this->octetMasses[after].size();
+        }
+        std::copy(this->octetMasses[octet].begin(), this->octetMasses[octet].end(),
+                  masses.begin() + offset);
+    }
+}
+
+void
+OctTree::essentialRecurse(Node *node, const vector_3d &lower, const vector_3d &upper,
+                          std::vector<double> &masses) {
+    if (essentialNode(node, lower, upper, masses)) {
+        Root *root = (Root *)node;
+        for (int i = 0; i < OCT_REGIONS; i++) {
+            essentialRecurse(root->children[i], lower, upper, masses);
+        }
+    }
+}
+
+bool
+OctTree::essentialNode(Node *node, const vector_3d &lower, const vector_3d &upper,
+                       std::vector<double> &masses) {
+    if (node == nullptr) {
+        return false;
+    }
+    if (node->isLeaf()) {
+        const Body &body = ((Leaf *)node)->body;
+        masses.push_back(std::get<X>(body.pos));
+        masses.push_back(std::get<Y>(body.pos));
+        masses.push_back(std::get<Z>(body.pos));
+        masses.push_back(body.mass);
+        return false;
+    }
+    Root *root = (Root *)node;
+    if (root->mass == 0) {
+        return false;
+    }
+
+    // Accept root only if it is far enough from the nearest point of the box,
+    // so that it is far enough from every body within the box
+    const vector_3d &com = root->centerOfMass;
+    bool overlaps = !(std::get<X>(upper) < std::get<X>(root->lowerBound) ||
+                      std::get<Y>(upper) < std::get<Y>(root->lowerBound) ||
+                      std::get<Z>(upper) < std::get<Z>(root->lowerBound) ||
+                      std::get<X>(lower) > std::get<X>(root->upperBound) ||
+                      std::get<Y>(lower) > std::get<Y>(root->upperBound) ||
+                      std::get<Z>(lower) > std::get<Z>(root->upperBound));
+    if (this->opening.accept(root->mass, root->size, root->bmax,
+                             nearestPointSq(com, lower, upper), 0.0, overlaps)) {
+        masses.push_back(std::get<X>(com));
+        masses.push_back(std::get<Y>(com));
+        masses.push_back(std::get<Z>(com));
+        masses.push_back(root->mass);
+        return false;
+    }
+    return true;
+}
+
 bool
 OctTree::checkParticleBounds(Leaf *particle) {
     Root *root = (Root *)particle->parent;
-    if (std::get<X>(particle->body.pos) < std::get<X>(root->lowerBound) ||
-        std::get<Y>(particle->body.pos) < std::get<Y>(root->lowerBound) ||
-        std::get<Z>(particle->body.pos) < std::get<Z>(root->lowerBound) ||
-        std::get<X>(particle->body.pos) > std::get<X>(root->upperBound) ||
-        std::get<Y>(particle->body.pos) > std::get<Y>(root->upperBound) ||
-        std::get<Z>(particle->body.pos) > std::get<Z>(root->upperBound)) {
+    if (outsideBounds(root, particle->body.pos)) {
         return true;
     }
-    return particle->octet != findOctet(root->pos, particle->body.pos);
+    // An overflow leaf may take any octet, so it only moves by leaving its parent
+    return !particle->overflow && particle->octet != findOctet(root->pos, particle->body.pos);
+}
+
+void
+OctTree::treeOrder(std::vector<Leaf *> &ordered) {
+    ordered.clear();
+    treeOrderRecurse(this->root, ordered);
+}
+
+void
+OctTree::treeOrderRecurse(Root *root, std::vector<Leaf *> &ordered) {
+    for (int i=0; i < OCT_REGIONS; i++) {
+        Node *child = root->children[i];
+        if (child == nullptr) {
+            continue;
+        } else if (child->isLeaf()) {
+            ordered.push_back((Leaf *)child);
+        } else {
+            treeOrderRecurse((Root *)child, ordered);
+        }
+    }
+}
+
+void
+OctTree::treeIndex(std::vector<int> &order) {
+    if (outsideParallel()) {
+        #pragma omp parallel if(this->parallel)
+        treeIndex(order);
+        return;
+    }
+
+    // Each top-level octet is listed by its own task, then copied to its
+    // offset in order
+    #pragma omp single
+    {
+        for (int octet = 0; octet < OCT_REGIONS; octet++) {
+            #pragma omp task if(this->parallel)
+            {
+                std::vector<int> &indices = this->octetIndices[octet];
+                Node *child = this->root->children[octet];
+                indices.clear();
+                if (child != nullptr && child->isLeaf()) {
+                    indices.push_back(((Leaf *)child)->index);
+                } else if (child != nullptr) {
+                    treeIndexRecurse((Root *)child, indices);
+                }
+            }
+        }
+        #pragma omp taskwait
+        size_t total = 0;
+        for (int octet = 0; octet < OCT_REGIONS; octet++) {
+            total += this->octetIndices[octet].size();
+        }
+        order.resize(total);
+    }
+    #pragma omp for
+    for (int octet = 0; octet < OCT_REGIONS; octet++) {
+        size_t offset = 0;
+        for (int before = 0; before < octet; before++) {
+            offset += this->octetIndices[before].size();
+        }
+        std::copy(this->octetIndices[octet].begin(), this->octetIndices[octet].end(),
+                  order.begin() + offset);
+    }
+}
+
+void
+OctTree::treeIndexRecurse(Root *root, std::vector<int> &order) {
+    for (int i=0; i < OCT_REGIONS; i++) {
+        Node *child = root->children[i];
+        if (child == nullptr) {
+            continue;
+        } else if (child->isLeaf()) {
+            order.push_back(((Leaf *)child)->index);
+        } else {
+            treeIndexRecurse((Root *)child, order);
+        }
+    }
 }
 
 void
@@ -362,7 +849,7 @@ OctTree::print() {
 void
 OctTree::printRecurse(Root *root) {
     // Fixed iteration order to help with debugging
-    for(int i=0; i < 8; i++) {
+    for(int i=0; i < OCT_REGIONS; i++) {
         Node *child = root->children[i];
         if( child == nullptr ) {
             continue;
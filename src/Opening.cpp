@@ -0,0 +1,42 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Opening.cpp
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "Opening.h"
+
+double
+positiveEnv(const char *name, double fallback) {
+    char *value = std::getenv(name);
+    if (value == NULL || *value == '\0') {
+        return fallback;
+    }
+    double parsed = atof(value);
+    if (parsed <= 0) {
+        std::cerr << "ignoring " << name << "=" << value << " (expected a positive number)" <<
+            std::endl;
+        return fallback;
+    }
+    return parsed;
+}
+
+Opening::Opening() {
+    this->criterion = GEOMETRIC;
+    char *opening = std::getenv("OPENING");
+    if (opening != NULL && *opening != '\0') {
+        if (strcmp(opening, "bmax") == 0) {
+            this->criterion = BMAX;
+        } else if (strcmp(opening, "relative") == 0) {
+            this->criterion = RELATIVE;
+        } else if (strcmp(opening, "geometric") != 0) {
+            std::cerr << "ignoring OPENING=" << opening <<
+                " (expected geometric, bmax or relative)" << std::endl;
+        }
+    }
+    this->theta = positiveEnv("THETA", DEFAULT_THETA);
+    this->alpha = positiveEnv("ALPHA", DEFAULT_ALPHA);
+}
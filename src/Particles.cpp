@@ -0,0 +1,109 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Particles.cpp
+ */
+
+#include <algorithm>
+#include <omp.h>
+#include "Kernels.h"
+#include "Particles.h"
+
+constexpr int MOVE_BLOCK = SIMD_ALIGN / sizeof(double);  // thread ranges start on aligned bodies
+
+Particles::Particles(const std::vector<Leaf *> &leaves) {
+    int n = (int)leaves.size();
+    id.resize(n);
+    mass.resize(n);
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    vx.resize(n);
+    vy.resize(n);
+    vz.resize(n);
+    ax.resize(n);
+    ay.resize(n);
+    az.resize(n);
+    accMag.resize(n);
+    #pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+        const Body &body = leaves[i]->body;
+        id[i] = body.id;
+        mass[i] = body.mass;
+        x[i] = std::get<X>(body.pos);
+        y[i] = std::get<Y>(body.pos);
+        z[i] = std::get<Z>(body.pos);
+        vx[i] = std::get<X>(body.vel);
+        vy[i] = std::get<Y>(body.vel);
+        vz[i] = std::get<Z>(body.vel);
+        ax[i] = std::get<X>(body.acc);
+        ay[i] = std::get<Y>(body.acc);
+        az[i] = std::get<Z>(body.acc);
+        accMag[i] = body.accMag;
+    }
+}
+
+void
+Particles::move(double t, bool parallel) {
+    if (outsideParallel()) {
+        #pragma omp parallel if(parallel)
+        move(t, parallel);
+        return;
+    }
+    int n = size();
+
+    // Each thread moves a contiguous, aligned block of particles
+    int numThreads = omp_get_num_threads();
+    int blocks = (n + MOVE_BLOCK - 1) / MOVE_BLOCK;
+    int chunk = (blocks + numThreads - 1) / numThreads;
+    #pragma omp for schedule(static)
+    for (int thread = 0; thread < numThreads; thread++) {
+        int begin = std::min(n, thread * chunk * MOVE_BLOCK);
+        int end = std::min(n, begin + chunk * MOVE_BLOCK);
+        moveBodies(x.data(), y.data(), z.data(), vx.data(), vy.data(), vz.data(),
+                   ax.data(), ay.data(), az.data(), begin, end, t);
+    }
+}
+
+void
+Particles::moveParticle(int i, double t) {
+    moveBodies(x.data(), y.data(), z.data(), vx.data(), vy.data(), vz.data(),
+               ax.data(), ay.data(), az.data(), i, i + 1, t);
+}
+
+void
+Particles::permute(const std::vector<int> &order) {
+    if (outsideParallel()) {
+        #pragma omp parallel
+        permute(order);
+        return;
+    }
+    parallelGather(id, order);
+    parallelGather(mass, order);
+    parallelGather(x, order);
+    parallelGather(y, order);
+    parallelGather(z, order);
+    parallelGather(vx, order);
+    parallelGather(vy, order);
+    parallelGather(vz, order);
+    parallelGather(ax, order);
+    parallelGather(ay, order);
+    parallelGather(az, order);
+    parallelGather(accMag, order);
+}
+
+void
+Particles::logBody(int i, std::ofstream &f) const {
+    f << id[i] << " ";
+    f << mass[i] << " ";
+    f << x[i] << " ";
+    f << y[i] << " ";
+    f << z[i] << " ";
+    f << ax[i] << " ";
+    f << ay[i] << " ";
+    f << az[i] << " ";
+    f << vx[i] << " ";
+    f << vy[i] << " ";
+    f << vz[i] << " ";
+    f << std::endl;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Reorder.cpp
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include "Parallel.h"
+#include "Reorder.h"
+
+int
+reorderInterval() {
+    char *reorder = std::getenv("REORDER");
+    return reorder == NULL ? 0 : std::max(0, atoi(reorder));
+}
+
+void
+LeafStorage::release() {
+    for (int k = 0; k < this->count; k++) {
+        this->leaves[k].~Leaf();
+    }
+    ::operator delete(this->leaves);
+    this->leaves = nullptr;
+    this->count = 0;
+}
+
+void
+reorderParticles(std::vector<Leaf *> &particles, const std::vector<Leaf *> &ordered,
+                 LeafStorage &storage) {
+    if (outsideParallel()) {
+        #pragma omp parallel
+        reorderParticles(particles, ordered, storage);
+        return;
+    }
+    int n = (int)particles.size();
+
+    // Copy bodies into new contiguous storage in tree order, constructing each
+    // leaf in the same static blocks as the initial leaves
+    Leaf *next;
+    #pragma omp single copyprivate(next)
+    next = static_cast<Leaf *>(::operator new(sizeof(Leaf) * n));
+    #pragma omp for schedule(static)
+    for (int k = 0; k < n; k++) {
+        Leaf *leaf = new (&next[k]) Leaf(*ordered[k]);
+        leaf->parent = nullptr;
+        leaf->index = k;
+    }
+
+    // Free individually allocated particles from the first reorder
+    #pragma omp single
+    {
+        if (storage.leaves == nullptr) {
+            for (Leaf *particle : particles) {
+                delete particle;
+            }
+        }
+        storage.release();
+        storage.leaves = next;
+        storage.count = n;
+    }
+    #pragma omp for schedule(static)
+    for (int k = 0; k < n; k++) {
+        particles[k] = &next[k];
+    }
+}
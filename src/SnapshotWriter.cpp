@@ -0,0 +1,208 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: SnapshotWriter.cpp
+ */
+
+#include <cstdio>
+#include <string>
+#include "Affinity.h"
+#include "Parallel.h"
+#include "SnapshotWriter.h"
+
+/* Pack id and values of body in the snapshot layout */
+static void packValues(const Body &body, int &id, double *v) {
+    id = body.id;
+    v[SNAPSHOT_MASS] = body.mass;
+    v[SNAPSHOT_POS] = std::get<X>(body.pos);
+    v[SNAPSHOT_POS + 1] = std::get<Y>(body.pos);
+    v[SNAPSHOT_POS + 2] = std::get<Z>(body.pos);
+    v[SNAPSHOT_ACC] = std::get<X>(body.acc);
+    v[SNAPSHOT_ACC + 1] = std::get<Y>(body.acc);
+    v[SNAPSHOT_ACC + 2] = std::get<Z>(body.acc);
+    v[SNAPSHOT_VEL] = std::get<X>(body.vel);
+    v[SNAPSHOT_VEL + 1] = std::get<Y>(body.vel);
+    v[SNAPSHOT_VEL + 2] = std::get<Z>(body.vel);
+}
+
+/* Pack id and values of particle i in the snapshot layout */
+static void packValues(const Particles &particles, int i, int &id, double *v) {
+    id = particles.id[i];
+    v[SNAPSHOT_MASS] = particles.mass[i];
+    v[SNAPSHOT_POS] = particles.x[i];
+    v[SNAPSHOT_POS + 1] = particles.y[i];
+    v[SNAPSHOT_POS + 2] = particles.z[i];
+    v[SNAPSHOT_ACC] = particles.ax[i];
+    v[SNAPSHOT_ACC + 1] = particles.ay[i];
+    v[SNAPSHOT_ACC + 2] = particles.az[i];
+    v[SNAPSHOT_VEL] = particles.vx[i];
+    v[SNAPSHOT_VEL + 1] = particles.vy[i];
+    v[SNAPSHOT_VEL + 2] = particles.vz[i];
+}
+
+/* Format the text log line of body id with values v at step into line, as
+ * Body::logBody does, whose operator<< prints doubles as %g */
+static int formatLine(char *line, size_t size, int step, int id, const double *v) {
+    return snprintf(line, size, "%d %d %g %g %g %g %g %g %g %g %g %g \n", step, id, v[0], v[1],
+                    v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9]);
+}
+
+void
+appendLogLine(std::string &text, int step, const Body &body) {
+    int id;
+    double v[SNAPSHOT_VALUES];
+    packValues(body, id, v);
+    char line[512];
+    text.append(line, formatLine(line, sizeof(line), step, id, v));
+}
+
+SnapshotWriter::SnapshotWriter(std::ofstream *out, Trajectory *trajectory) :
+        out(out), trajectory(trajectory) {
+    this->full[0] = this->full[1] = false;
+    this->next = 0;
+    this->current = 0;
+    this->done = false;
+    this->thread = std::thread(&SnapshotWriter::run, this);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->done = true;
+    }
+    this->changed.notify_all();
+    this->thread.join();
+}
+
+SnapshotWriter::Snapshot &
+SnapshotWriter::acquire(int step, int n) {
+    // Wait for the writer to finish with the buffer (backpressure)
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->changed.wait(guard, [this] { return !this->full[this->next]; });
+    Snapshot &snapshot = this->buffers[this->next];
+    snapshot.step = step;
+    snapshot.id.resize(n);
+    snapshot.values.resize((size_t)n * SNAPSHOT_VALUES);
+    return snapshot;
+}
+
+void
+SnapshotWriter::submit() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->full[this->next] = true;
+        this->next ^= 1;
+    }
+    this->changed.notify_all();
+}
+
+void
+SnapshotWriter::write(int step, const std::vector<Leaf *> &particles) {
+    if (outsideParallel()) {
+        #pragma omp parallel
+        write(step, particles);
+        return;
+    }
+    int n = (int)particles.size();
+    #pragma omp single
+    acquire(step, n);
+    Snapshot &snapshot = this->buffers[this->next];
+    #pragma omp for
+    for (int i = 0; i < n; i++) {
+        packValues(particles[i]->body, snapshot.id[i],
+                   &snapshot.values[(size_t)i * SNAPSHOT_VALUES]);
+    }
+    #pragma omp single
+    submit();
+}
+
+void
+SnapshotWriter::write(int step, const Particles &particles) {
+    if (outsideParallel()) {
+        #pragma omp parallel
+        write(step, particles);
+        return;
+    }
+    int n = particles.size();
+    #pragma omp single
+    acquire(step, n);
+    Snapshot &snapshot = this->buffers[this->next];
+    #pragma omp for
+    for (int i = 0; i < n; i++) {
+        packValues(particles, i, snapshot.id[i], &snapshot.values[(size_t)i * SNAPSHOT_VALUES]);
+    }
+    #pragma omp single
+    submit();
+}
+
+void
+SnapshotWriter::write(int step, const std::vector<Body> &bodies) {
+    if (outsideParallel()) {
+        #pragma omp parallel
+        write(step, bodies);
+        return;
+    }
+    int n = (int)bodies.size();
+    #pragma omp single
+    acquire(step, n);
+    Snapshot &snapshot = this->buffers[this->next];
+    #pragma omp for
+    for (int i = 0; i < n; i++) {
+        packValues(bodies[i], snapshot.id[i], &snapshot.values[(size_t)i * SNAPSHOT_VALUES]);
+    }
+    #pragma omp single
+    submit();
+}
+
+void
+SnapshotWriter::flush() {
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->changed.wait(guard, [this] { return !this->full[0] && !this->full[1]; });
+    if (this->out != nullptr) {
+        this->out->flush();
+    }
+}
+
+void
+SnapshotWriter::run() {
+    unpinThread();
+    std::string text;
+    text.reserve(SNAPSHOT_CHUNK + 512);
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(this->lock);
+            this->changed.wait(guard, [this] { return this->full[this->current] || this->done; });
+            if (!this->full[this->current]) {
+                return;
+            }
+        }
+
+        const Snapshot &snapshot = this->buffers[this->current];
+        int n = (int)snapshot.id.size();
+        if (this->trajectory != nullptr) {
+            this->trajectory->writeFrame(snapshot.step, snapshot.id.data(),
+                                         snapshot.values.data(), n);
+        }
+
+        if (this->out != nullptr) {
+            char line[512];
+            for (int i = 0; i < n; i++) {
+                const double *v = &snapshot.values[(size_t)i * SNAPSHOT_VALUES];
+                text.append(line, formatLine(line, sizeof(line), snapshot.step, snapshot.id[i], v));
+                if (text.size() >= SNAPSHOT_CHUNK) {
+                    this->out->write(text.data(), text.size());
+                    text.clear();
+                }
+            }
+            this->out->write(text.data(), text.size());
+            text.clear();
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->full[this->current] = false;
+            this->current ^= 1;
+        }
+        this->changed.notify_all();
+    }
+}
@@ -0,0 +1,272 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: Trajectory.cpp
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include "SnapshotWriter.h"
+#include "Trajectory.h"
+
+static_assert(sizeof(TrajectoryHeader) == 64, "TrajectoryHeader layout must not change");
+static_assert(sizeof(FrameHeader) == 24, "FrameHeader layout must not change");
+static_assert(sizeof(TrajectoryTrailer) == 24, "TrajectoryTrailer layout must not change");
+
+constexpr double GRID_LIMIT = 4.6e18;  // grid coordinates stay below 2^62, so changes fit
+
+/* Parse FIELDS, a comma separated list of pos, vel, acc and mass (or all) */
+static uint32_t parseFields() {
+    char *value = std::getenv("FIELDS");
+    if (value == NULL || *value == '\0') {
+        return FIELD_POS;
+    }
+    uint32_t fields = 0;
+    std::string list(value);
+    size_t begin = 0;
+    while (begin <= list.size()) {
+        size_t end = std::min(list.find(',', begin), list.size());
+        std::string field = list.substr(begin, end - begin);
+        if (field == "pos") {
+            fields |= FIELD_POS;
+        } else if (field == "vel") {
+            fields |= FIELD_VEL;
+        } else if (field == "acc") {
+            fields |= FIELD_ACC;
+        } else if (field == "mass") {
+            fields |= FIELD_MASS;
+        } else if (field == "all") {
+            fields |= FIELD_POS | FIELD_VEL | FIELD_ACC | FIELD_MASS;
+        } else {
+            std::cerr << "ignoring FIELDS=" << value <<
+                " (expected a comma separated list of pos, vel, acc, mass or all)" << std::endl;
+            return FIELD_POS;
+        }
+        begin = end + 1;
+    }
+    return fields;
+}
+
+/* Append the bytes of value to out */
+template <typename T>
+static void append(std::vector<char> &out, const T &value) {
+    const char *bytes = (const char *)&value;
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+/* Append v as a varint, 7 bits per byte with the high bit set on all but the last */
+static void appendVarint(std::vector<char> &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+/* Map signed to unsigned so small magnitudes of either sign encode short */
+static uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+Trajectory::Trajectory(const char *path, const vector_3d &origin) : origin(origin) {
+    this->out.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    this->fields = parseFields();
+    this->quantum = 0.0;
+    char *quantize = std::getenv("QUANTIZE");
+    if (quantize != NULL && *quantize != '\0') {
+        this->quantum = atof(quantize);
+        if (!(this->quantum > 0)) {
+            std::cerr << "ignoring QUANTIZE=" << quantize << " (expected a positive number)" <<
+                std::endl;
+            this->quantum = 0.0;
+        }
+    }
+    this->keyframe = DEFAULT_KEYFRAME;
+    char *keyframe = std::getenv("KEYFRAME");
+    if (keyframe != NULL && *keyframe != '\0') {
+        if (atoi(keyframe) > 0) {
+            this->keyframe = atoi(keyframe);
+        } else {
+            std::cerr << "ignoring KEYFRAME=" << keyframe << " (expected a positive integer)" <<
+                std::endl;
+        }
+    }
+    this->started = false;
+    this->count = 0;
+    this->quantized = false;
+    this->written = 0;
+}
+
+Trajectory::~Trajectory() {
+    if (!this->out.is_open()) {
+        return;
+    }
+    if (!this->started) {
+        start(nullptr, 0);
+    }
+    TrajectoryTrailer trailer;
+    trailer.indexOffset = this->written;
+    trailer.frames = this->offsets.size();
+    memcpy(trailer.magic, TRAJECTORY_INDEX_MAGIC, sizeof(TRAJECTORY_INDEX_MAGIC));
+    this->out.write((const char *)this->offsets.data(), this->offsets.size() * sizeof(uint64_t));
+    this->out.write((const char *)&trailer, sizeof(trailer));
+    this->out.close();
+}
+
+void
+Trajectory::start(const int *id, int n) {
+    sortBodies(id, n);
+    this->count = n;
+    this->ids.resize(n);
+    for (int k = 0; k < n; k++) {
+        this->ids[k] = id[this->order[k]];
+    }
+
+    TrajectoryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+    header.version = TRAJECTORY_VERSION;
+    header.fields = this->fields;
+    header.count = this->count;
+    header.keyframe = this->keyframe;
+    header.quantum = this->quantum;
+    header.origin[X] = std::get<X>(this->origin);
+    header.origin[Y] = std::get<Y>(this->origin);
+    header.origin[Z] = std::get<Z>(this->origin);
+    this->payload.clear();
+    append(this->payload, header);
+    for (int k = 0; k < n; k++) {
+        append(this->payload, (int32_t)this->ids[k]);
+    }
+    this->payload.resize((this->payload.size() + 7) / 8 * 8, 0);
+    this->out.write(this->payload.data(), this->payload.size());
+    this->written += this->payload.size();
+    this->started = true;
+}
+
+void
+Trajectory::sortBodies(const int *id, int n) {
+    // Bodies keep their order between most steps, reordering aside
+    bool same = (int)this->order.size() == n && (int)this->ids.size() == n;
+    for (int k = 0; same && k < n; k++) {
+        same = id[this->order[k]] == this->ids[k];
+    }
+    if (same) {
+        return;
+    }
+    this->order.resize(n);
+    std::iota(this->order.begin(), this->order.end(), 0);
+    std::sort(this->order.begin(), this->order.end(), [id](int a, int b) {
+        return id[a] < id[b];
+    });
+}
+
+uint32_t
+Trajectory::encodePositions(const double *values, int n) {
+    double o[3] = {std::get<X>(this->origin), std::get<Y>(this->origin),
+                   std::get<Z>(this->origin)};
+    if (this->quantum > 0) {
+        // Grid coordinates, unless a body is too far from the origin for them
+        std::vector<int64_t> current((size_t)3 * n);
+        bool fits = true;
+        for (int c = 0; c < 3 && fits; c++) {
+            for (int k = 0; k < n; k++) {
+                size_t v = (size_t)this->order[k] * SNAPSHOT_VALUES + SNAPSHOT_POS + c;
+                double g = (values[v] - o[c]) / this->quantum;
+                if (!(fabs(g) < GRID_LIMIT)) {
+                    fits = false;
+                    break;
+                }
+                current[(size_t)c * n + k] = llround(g);
+            }
+        }
+        if (fits) {
+            bool delta = this->quantized && this->offsets.size() % this->keyframe != 0;
+            for (size_t j = 0; j < current.size(); j++) {
+                int64_t value = delta ? current[j] - this->grid[j] : current[j];
+                appendVarint(this->payload, zigzag(value));
+            }
+            this->grid.swap(current);
+            this->quantized = true;
+            return delta ? FRAME_DELTA : FRAME_KEY;
+        }
+    }
+
+    this->quantized = false;
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < n; k++) {
+            size_t v = (size_t)this->order[k] * SNAPSHOT_VALUES + SNAPSHOT_POS + c;
+            append(this->payload, values[v]);
+        }
+    }
+    return FRAME_RAW;
+}
+
+void
+Trajectory::writeFrame(int step, const int *id, const double *values, int n) {
+    if (!this->started) {
+        start(id, n);
+    }
+    if ((uint64_t)n != this->count) {
+        std::cerr << "trajectory: skipping step " << step << " with " << n << " bodies (expected "
+                  << this->count << ")" << std::endl;
+        return;
+    }
+    sortBodies(id, n);
+
+    // Columns of the selected fields, in id order
+    this->payload.clear();
+    auto column = [&](int v) {
+        for (int k = 0; k < n; k++) {
+            append(this->payload, values[(size_t)this->order[k] * SNAPSHOT_VALUES + v]);
+        }
+    };
+    if (this->fields & FIELD_VEL) {
+        column(SNAPSHOT_VEL);
+        column(SNAPSHOT_VEL + 1);
+        column(SNAPSHOT_VEL + 2);
+    }
+    if (this->fields & FIELD_ACC) {
+        column(SNAPSHOT_ACC);
+        column(SNAPSHOT_ACC + 1);
+        column(SNAPSHOT_ACC + 2);
+    }
+    if (this->fields & FIELD_MASS) {
+        column(SNAPSHOT_MASS);
+    }
+    FrameHeader header;
+    header.step = step;
+    header.encoding = FRAME_RAW;
+    header.posBytes = 0;
+    if (this->fields & FIELD_POS) {
+        size_t before = this->payload.size();
+        header.encoding = encodePositions(values, n);
+        header.posBytes = this->payload.size() - before;
+    }
+    this->payload.resize((this->payload.size() + 7) / 8 * 8, 0);
+    header.bytes = this->payload.size();
+
+    this->offsets.push_back(this->written);
+    this->out.write((const char *)&header, sizeof(header));
+    this->out.write(this->payload.data(), this->payload.size());
+    this->written += sizeof(header) + this->payload.size();
+}
+
+Trajectory *
+openTrajectory(const vector_3d &origin) {
+    char *path = std::getenv("TRAJECTORY");
+    if (path == NULL || *path == '\0') {
+        return nullptr;
+    }
+    Trajectory *trajectory = new Trajectory(path, origin);
+    if (!trajectory->is_open()) {
+        std::cerr << "ignoring TRAJECTORY=" << path << " (unable to open)" << std::endl;
+        delete trajectory;
+        return nullptr;
+    }
+    return trajectory;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: UpdatePolicy.cpp
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "UpdatePolicy.h"
+
+UpdatePolicy::UpdatePolicy() {
+    this->forced = -1;
+    char *update = std::getenv("UPDATE");
+    if (update != NULL && *update != '\0') {
+        if (strcmp(update, "rebuild") == 0) {
+            this->forced = REBUILD;
+        } else if (strcmp(update, "incremental") == 0) {
+            this->forced = INCREMENTAL;
+        } else {
+            std::cerr << "ignoring UPDATE=" << update <<
+                " (expected rebuild or incremental)" << std::endl;
+        }
+    }
+    this->rebuildCost = -1;
+    this->sumWeight = 0;
+    this->sumMoved = 0;
+    this->sumTime = 0;
+    this->sumMovedSq = 0;
+    this->sumMovedTime = 0;
+    this->sinceProbe = 0;
+    this->last = INCREMENTAL;
+    this->rebuilds = 0;
+    this->incrementals = 0;
+}
+
+double
+UpdatePolicy::incrementalCost(int numMoved) {
+    if (this->sumWeight == 0) {
+        return -1;
+    }
+    double meanMoved = this->sumMoved / this->sumWeight;
+    double meanTime = this->sumTime / this->sumWeight;
+    double variance = this->sumMovedSq / this->sumWeight - meanMoved * meanMoved;
+    if (variance <= 1e-9 * (meanMoved * meanMoved + 1)) {
+        // Not enough spread in moved counts for a slope, scale the average
+        return meanMoved > 0 ? meanTime * numMoved / meanMoved : meanTime;
+    }
+    double perMoved = (this->sumMovedTime / this->sumWeight - meanMoved * meanTime) / variance;
+    if (perMoved < 0) {
+        perMoved = 0;
+    }
+    double fixed = meanTime - perMoved * meanMoved;
+    if (fixed < 0) {
+        fixed = 0;
+    }
+    return fixed + perMoved * numMoved;
+}
+
+UpdateStrategy
+UpdatePolicy::choose(int numMoved) {
+    UpdateStrategy strategy;
+    double incremental = incrementalCost(numMoved);
+    if (this->forced != -1) {
+        strategy = (UpdateStrategy)this->forced;
+    } else if (incremental < 0) {
+        // Measure each strategy once before trusting the model
+        strategy = INCREMENTAL;
+    } else if (this->rebuildCost < 0) {
+        strategy = REBUILD;
+    } else {
+        strategy = incremental <= this->rebuildCost ? INCREMENTAL : REBUILD;
+        // Periodically measure the other strategy so that the model tracks
+        // changes in the distribution of particles
+        if (strategy == this->last && ++this->sinceProbe >= PROBE_INTERVAL) {
+            strategy = strategy == REBUILD ? INCREMENTAL : REBUILD;
+        }
+    }
+    if (strategy != this->last) {
+        this->sinceProbe = 0;
+    }
+    this->last = strategy;
+    return strategy;
+}
+
+void
+UpdatePolicy::record(UpdateStrategy strategy, int numMoved, long long micros) {
+    double time = (double)micros;
+    if (strategy == REBUILD) {
+        this->rebuilds += 1;
+        this->rebuildCost = this->rebuildCost < 0 ? time :
+            COST_DECAY * this->rebuildCost + (1 - COST_DECAY) * time;
+    } else {
+        this->incrementals += 1;
+        this->sumWeight = COST_DECAY * this->sumWeight + 1;
+        this->sumMoved = COST_DECAY * this->sumMoved + numMoved;
+        this->sumTime = COST_DECAY * this->sumTime + time;
+        this->sumMovedSq = COST_DECAY * this->sumMovedSq + (double)numMoved * numMoved;
+        this->sumMovedTime = COST_DECAY * this->sumMovedTime + numMoved * time;
+    }
+}
@@ -4,8 +4,17 @@
  * BarnesHutSimulation: barnesHut.cpp
  */
 
+#include "BlockIntegrator.h"
+#include "FastMultipole.h"
+#include "InputFile.h"
+#include "Kernels.h"
+#include "LinearOctTree.h"
 #include "OctTree.h"
+#include "Reorder.h"
+#include "SnapshotWriter.h"
 #include "Timer.h"
+#include "Trajectory.h"
+#include "UpdatePolicy.h"
 #include <fstream>
 #include <string>
 #include <vector>
@@ -13,13 +22,6 @@
 constexpr bool DEBUG = true;  // print debug output
 constexpr int DELTA = 1;      // length of time step: 1 second
 
-/* Read simulation bounds from input file */
-vector_3d getBounds(std::ifstream &f) {
-    double x, y, z;
-    f >> x >> y >> z;
-    return std::make_tuple(x, y, z);
-}
-
 int main(int argc, char *argv[]) {
     // Get command line args:
     //  steps     - number of time steps to simulate
@@ -48,9 +50,8 @@ int main(int argc, char *argv[]) {
         std::cout << "Output File: " << argv[3] << std::endl;
     }
 
-    // Open input file
-    std::ifstream infile;
-    infile.open(argv[2], std::ios::in);
+    // Open input file, text or binary (memory mapped)
+    InputFile infile(argv[2]);
     if (!infile.is_open()) {
         std::cerr << "Unable to open " << argv[2] << std::endl;
         exit(-1);
@@ -64,67 +65,199 @@ int main(int argc, char *argv[]) {
         exit(-1);
     }
     bool log = NULL != std::getenv("LOG");
+    bool fmm = NULL != std::getenv("FMM");  // dual-tree solver over LinearOctTree
+    bool leapfrog = NULL != std::getenv("LEAPFROG");  // block time steps over LinearOctTree
+    bool linear = fmm || leapfrog || NULL != std::getenv("LINEAR");
+    bool group = NULL != std::getenv("GROUP");  // LinearOctTree walks once per group
+    int reorder = reorderInterval();
 
-    // Parse input file and construct vector of Leaf objects
-    int numParticles;
-    infile >> numParticles;
-    vector_3d lowerBound = getBounds(infile);
-    vector_3d upperBound = getBounds(infile);
+    // Construct vector of Leaf objects from the input file
+    int numParticles = infile.size();
+    vector_3d lowerBound = infile.lower();
+    vector_3d upperBound = infile.upper();
     std::vector<Leaf *> particles(numParticles);
     for (int i=0; i < numParticles; i++) {
-        particles[i] = new Leaf(nullptr, getBody(infile));
+        particles[i] = new Leaf(nullptr, infile.body(i));
     }
-    infile.close();
 
-    // Write initial positions
+    // Write initial positions, as text with LOG and as a binary trajectory
+    // with TRAJECTORY. Time steps are written by a background thread while
+    // the simulation continues.
+    Trajectory *trajectory = openTrajectory(lowerBound);
+    SnapshotWriter *writer = nullptr;
     if (log) {
         outfile << numParticles << std::endl;
         outfile << steps << std::endl;
-        for (int i = 0; i < numParticles; i++) {
-            outfile << 0 << " ";
-            particles[i]->body.logBody(outfile);
-        }
+    }
+    if (log || trajectory != nullptr) {
+        writer = new SnapshotWriter(log ? &outfile : nullptr, trajectory);
+        writer->write(0, particles);
     }
 
     // Start timer
     Timer timer = Timer();
     timer.start();
 
+    // Construct OctTree from vector of particles. Root nodes are recycled
+    // through the arena across rebuilds and incremental updates.
+    NodeArena arena(arenaPools());
+    OctTree *tree = nullptr;
+    if (!linear) {
+        tree = new OctTree(particles, lowerBound, upperBound, &arena);
+        tree->setCenterOfMass();
+    }
+    // LinearOctTree reads bodies from a struct of arrays copy of particles.
+    // One tree persists across steps and is rebuilt in place, only when a
+    // particle leaves its leaf or particles are reordered.
+    LinearOctTree *linearTree = nullptr;
+    Particles *bodies = nullptr;
+    FastMultipole *solver = nullptr;
+    BlockIntegrator *integrator = nullptr;
+    if (linear) {
+        bodies = new Particles(particles);
+        linearTree = new LinearOctTree(*bodies, lowerBound, upperBound);
+        linearTree->setCenterOfMass();
+        solver = new FastMultipole(*linearTree);
+        integrator = new BlockIntegrator(*bodies, *linearTree);
+    }
+    std::vector<Leaf *> moved;
+    std::vector<Leaf *> ordered;
+    LeafStorage storage;
+    UpdatePolicy policy = UpdatePolicy();
+
     // Perform Barnes-Hut simulation for given number of time steps
     for (int i = 0; i < steps; i++) {
-        // Construct OctTree from vector of particles
-        OctTree tree = OctTree(particles, lowerBound, upperBound);
+        // Periodically store particles in tree order, so that neighbouring
+        // iterations of the particle loops walk the same parts of the tree
+        bool reorderStep = reorder > 0 && (i + 1) % reorder == 0;
 
-        // Update OctTree to cache center of mass for each octet at Root node
-        tree.setCenterOfMass();
+        bool rebuild = false;
+        if (leapfrog) {
+            // forces and movement of every substep are done by the integrator
+            integrator->step(DELTA, false);
+            for (int j = 0; j < numParticles; j++) {
+                rebuild |= linearTree->checkParticleBounds(j);
+            }
+        } else if (linear) {
+            // for each particle, calculate total gravitational force and update accelerations
+            if (fmm) {
+                solver->forces(false);
+            } else if (group) {
+                linearTree->groupForces(false);
+            } else {
+                for (int j = 0; j < numParticles; j++) {
+                    vector_3d f = linearTree->treeForce(j);
+                    bodies->apply(j, f);
+                }
+            }
 
-        // for each particle, calculate total gravitational force and update accelerations
-        for (Leaf *p: particles) {
-            vector_3d f = tree.treeForce(p);
-            p->body.apply(f);
+            // simulate movement of time step and find particles that left their leaf
+            for (int j = 0; j < numParticles; j++) {
+                bodies->moveParticle(j, DELTA);
+                rebuild |= linearTree->checkParticleBounds(j);
+            }
+        } else {
+            // for each particle, calculate total gravitational force and update accelerations
+            for (Leaf *p: particles) {
+                vector_3d f = tree->treeForce(p);
+                p->body.apply(f);
+            }
         }
 
         // simulate movement of time step
-        for (Leaf *p: particles) {
-            p->body.move(DELTA);
+        if (!linear) {
+            for (Leaf *p: particles) {
+                p->body.move(DELTA);
+            }
         }
 
         // log new positions to file
-        if (log) {
-            for (int j = 0; j < numParticles; j++) {
-                outfile << i+1 << " ";
-                particles[j]->body.logBody(outfile);
+        if (writer != nullptr && linear) {
+            writer->write(i+1, *bodies);
+        } else if (writer != nullptr) {
+            writer->write(i+1, particles);
+        }
+
+        if (linear) {
+            if (reorderStep && leapfrog) {
+                integrator->reorder(linearTree->treeOrder());
+            } else if (reorderStep) {
+                bodies->permute(linearTree->treeOrder());
+            }
+            if (rebuild || reorderStep) {
+                linearTree->build();
+            }
+
+            // Update LinearOctTree to cache center of mass for each node
+            linearTree->setCenterOfMass();
+            continue;
+        }
+
+        // Periodically store particles in tree order and rebuild over them
+        if (reorderStep) {
+            tree->treeOrder(ordered);
+            reorderParticles(particles, ordered, storage);
+            tree->rebuild(particles);
+            tree->setCenterOfMass();
+            continue;
+        }
+
+        // find all out of bounds particles
+        moved.clear();
+        for (Leaf *p: particles) {
+            if (tree->checkParticleBounds(p)) {
+                moved.push_back(p);
             }
         }
+
+        // Rebuild tree or remove and re-insert out of bounds particles,
+        // whichever the measured cost model predicts is cheaper
+        UpdateStrategy strategy = policy.choose((int)moved.size());
+        Timer updateTimer = Timer();
+        updateTimer.start();
+        if (strategy == REBUILD) {
+            tree->rebuild(particles);
+        } else {
+            tree->reinsertParticles(moved);
+        }
+        updateTimer.stop();
+        policy.record(strategy, (int)moved.size(), updateTimer.duration());
+
+        // Update OctTree to cache center of mass for each octet at Root node
+        tree->setCenterOfMass();
     }
 
+    // Logged steps still count towards the time of the simulation
+    if (writer != nullptr) {
+        writer->flush();
+    }
     timer.stop();
     std::cout << timer << std::endl;
+    if (DEBUG && !linear) {
+        std::cout << "Tree Nodes: " << arena.nodesInUse() << " (" <<
+            arena.bytesReserved() << " bytes reserved)" << std::endl;
+        std::cout << "Tree Updates: " << policy.rebuilds << " rebuilds, " <<
+            policy.incrementals << " incremental" << std::endl;
+    }
+    if (DEBUG && linear) {
+        std::cout << "Kernels: " << kernelName() << std::endl;
+    }
+    if (DEBUG && leapfrog) {
+        std::cout << "Force Evaluations: " << integrator->forceEvaluations <<
+            " in last step" << std::endl;
+    }
     outfile << timer.duration() << std::endl;
 
 
-    // Close output file and free memory allocated for particles
+    // Close output file and free memory allocated for tree and particles
+    delete writer;
+    delete trajectory;
     outfile.close();
+    delete tree;
+    delete integrator;
+    delete solver;
+    delete linearTree;
+    delete bodies;
     particles.clear();
 
     return 0;
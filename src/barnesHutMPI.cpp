@@ -0,0 +1,285 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: barnesHutMPI.cpp
+ */
+
+#include "Domain.h"
+#include "InputFile.h"
+#include "NodeArena.h"
+#include "OctTree.h"
+#include "SnapshotWriter.h"
+#include "Timer.h"
+#include "Trajectory.h"
+#include <algorithm>
+#include <mpi.h>
+#include <omp.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+constexpr bool DEBUG = true;  // print debug output
+constexpr int DELTA = 1;      // length of time step: 1 second
+
+/* Stop every rank after an error on rank 0 */
+void abortAll(const std::string &message) {
+    std::cerr << message << std::endl;
+    MPI_Abort(MPI_COMM_WORLD, -1);
+}
+
+/* Write text at offset of file, in pieces of at most SNAPSHOT_CHUNK bytes */
+void writeText(MPI_File file, MPI_Offset offset, const std::string &text) {
+    for (size_t begin = 0; begin < text.size(); begin += SNAPSHOT_CHUNK) {
+        int length = (int)std::min(SNAPSHOT_CHUNK, text.size() - begin);
+        MPI_File_write_at(file, offset + (MPI_Offset)begin, text.data() + begin, length, MPI_CHAR,
+                          MPI_STATUS_IGNORE);
+    }
+}
+
+/* Write the log lines of this rank's bodies at step to file. Every rank writes
+ * its own lines, after those of all lower ranks, starting at end, which is then
+ * advanced past the lines of all ranks. */
+void logStep(MPI_File file, MPI_Offset &end, int step, const std::vector<Body> &bodies) {
+    // Each thread formats a contiguous chunk of bodies
+    int n = (int)bodies.size();
+    std::vector<std::string> text(omp_get_max_threads());
+    #pragma omp parallel
+    {
+        int t = omp_get_thread_num();
+        int numThreads = omp_get_num_threads();
+        int chunk = (n + numThreads - 1) / numThreads;
+        int begin = std::min(n, t * chunk);
+        int last = std::min(n, begin + chunk);
+        for (int j = begin; j < last; j++) {
+            appendLogLine(text[t], step, bodies[j]);
+        }
+    }
+
+    long long length = 0;
+    for (const std::string &chunk : text) {
+        length += (long long)chunk.size();
+    }
+    long long through = 0, total = 0;
+    MPI_Scan(&length, &through, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&length, &total, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Offset offset = end + (MPI_Offset)(through - length);
+    for (const std::string &chunk : text) {
+        writeText(file, offset, chunk);
+        offset += (MPI_Offset)chunk.size();
+    }
+    end += (MPI_Offset)total;
+}
+
+int main(int argc, char *argv[]) {
+    // Ranks only call MPI outside of OpenMP parallel regions
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    Domain domain = Domain();
+    bool root = domain.getRank() == 0;
+    if (provided < MPI_THREAD_FUNNELED) {
+        if (root) {
+            abortAll("MPI library does not support MPI_THREAD_FUNNELED, needed with OpenMP");
+        }
+        MPI_Finalize();
+        return -1;
+    }
+
+    // Get command line args:
+    //  steps     - number of time steps to simulate
+    //  inputFile - path to input file, which contains simulation bounds and particles
+    //  outputFile - path to output file, where simulation results will be written
+    if (argc < 4) {
+        if (root) {
+            abortAll("Usage: mpirun -np <ranks> ./barnesHutMPI <steps> <input_filename> "
+                     "<output_filename>");
+        }
+        MPI_Finalize();
+        return -1;
+    }
+
+    // Parse number of time steps to execute simulation for
+    int steps = 0;
+    try {
+        steps = std::stoi(argv[1]);
+    } catch (std::invalid_argument const &e) {
+        abortAll(std::string("invalid integer: ") + argv[1]);
+    } catch (std::out_of_range const &e) {
+        abortAll("integer out of range");
+    }
+
+    if (DEBUG && root) {
+        std::cout << "Time Steps: " << steps << std::endl;
+        std::cout << "Input File: " << argv[2] << std::endl;
+        std::cout << "Output File: " << argv[3] << std::endl;
+        std::cout << "Ranks: " << domain.getNumRanks() << std::endl;
+    }
+
+    // Every rank reads its own slice of the input file. Binary inputs are
+    // memory mapped, so each rank only reads the pages of its slice. Bodies
+    // are spread along the curve by the first decomposition.
+    bool log = NULL != std::getenv("LOG");
+    std::vector<Body> bodies;
+    int numParticles = 0;
+    vector_3d lowerBound, upperBound;
+    {
+        InputFile infile(argv[2]);
+        if (!infile.is_open()) {
+            if (root) {
+                abortAll(std::string("Unable to open ") + argv[2]);
+            }
+            MPI_Finalize();
+            return -1;
+        }
+        numParticles = infile.size();
+        lowerBound = infile.lower();
+        upperBound = infile.upper();
+        int rank = domain.getRank();
+        int numRanks = domain.getNumRanks();
+        int begin = (int)((long)numParticles * rank / numRanks);
+        int end = (int)((long)numParticles * (rank + 1) / numRanks);
+        bodies.resize(end - begin);
+        #pragma omp parallel for
+        for (int i = begin; i < end; i++) {
+            bodies[i - begin] = infile.body(i);
+        }
+    }
+
+    // All ranks write the output file through MPI-IO. With LOG, each rank
+    // writes the lines of its own bodies, so lines of a time step are grouped
+    // by rank rather than ordered by id.
+    MPI_File outfile;
+    if (MPI_File_open(MPI_COMM_WORLD, argv[3], MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                      &outfile) != MPI_SUCCESS) {
+        if (root) {
+            abortAll(std::string("Unable to open ") + argv[3]);
+        }
+        MPI_Finalize();
+        return -1;
+    }
+    MPI_File_set_size(outfile, 0);
+    MPI_Offset end = 0;
+    if (log) {
+        std::string header = std::to_string(numParticles) + "\n" + std::to_string(steps) + "\n";
+        if (root) {
+            writeText(outfile, 0, header);
+        }
+        end = (MPI_Offset)header.size();
+        logStep(outfile, end, 0, bodies);
+    }
+
+    // A binary trajectory (TRAJECTORY) holds every body of a frame in id
+    // order, so logged steps are gathered on rank 0 and written there by a
+    // background thread while the simulation continues.
+    char *path = std::getenv("TRAJECTORY");
+    bool record = path != NULL && *path != '\0';
+    Trajectory *trajectory = root ? openTrajectory(lowerBound) : nullptr;
+    SnapshotWriter *writer = nullptr;
+    std::vector<Body> all;
+    if (record) {
+        domain.gather(bodies, all);
+        if (trajectory != nullptr) {
+            writer = new SnapshotWriter(nullptr, trajectory);
+            writer->write(0, all);
+        }
+    }
+
+    // Start timer
+    MPI_Barrier(MPI_COMM_WORLD);
+    Timer timer = Timer();
+    timer.start();
+
+    // Each rank's OctTree first holds its own bodies, to find what other
+    // ranks need from it, then its locally essential tree: its own bodies
+    // plus the point masses imported from all other ranks.
+    NodeArena arena(arenaPools());
+    OctTree *tree = nullptr;
+    std::vector<double> work(bodies.size(), 1.0);  // interactions of each body in the last step
+    std::vector<Leaf> local;
+    std::vector<Leaf> remote;
+    std::vector<Leaf *> particles;
+    std::vector<double> masses;
+    for (int i = 0; i < steps; i++) {
+        // Migrate bodies to the ranks owning their part of the curve
+        domain.decompose(bodies, work);
+        int numLocal = (int)bodies.size();
+        local.clear();
+        local.reserve(numLocal);
+        particles.resize(numLocal);
+        for (int j = 0; j < numLocal; j++) {
+            local.push_back(Leaf(nullptr, Body(bodies[j])));
+            particles[j] = &local[j];
+        }
+        if (tree == nullptr) {
+            tree = new OctTree(particles, lowerBound, upperBound, &arena);
+        } else {
+            tree->rebuild(particles);
+        }
+        tree->setCenterOfMass();
+
+        // Build locally essential tree
+        domain.exchange(*tree, bodies, masses);
+        int numRemote = (int)(masses.size() / 4);
+        remote.clear();
+        remote.reserve(numRemote);
+        for (int k = 0; k < numRemote; k++) {
+            const double *m = &masses[4 * k];
+            remote.push_back(Leaf(nullptr, Body(-1, m[3], std::make_tuple(m[0], m[1], m[2]))));
+            particles.push_back(&remote[k]);
+        }
+        tree->rebuild(particles);
+        tree->setCenterOfMass();
+
+        // for each local particle, calculate total gravitational force and
+        // update accelerations, counting interactions for the next decomposition
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (int j = 0; j < numLocal; j++) {
+            int interactions = 0;
+            local[j].body.apply(tree->treeForce(&local[j], &interactions));
+            work[j] = interactions;
+        }
+
+        // simulate movement of time step
+        #pragma omp parallel for
+        for (int j = 0; j < numLocal; j++) {
+            local[j].body.move(DELTA);
+            bodies[j] = local[j].body;
+        }
+
+        // log new positions to file
+        if (log) {
+            logStep(outfile, end, i+1, bodies);
+        }
+        if (record) {
+            domain.gather(bodies, all);
+            if (writer != nullptr) {
+                writer->write(i+1, all);
+            }
+        }
+    }
+
+    // Logged steps still count towards the time of the simulation
+    if (writer != nullptr) {
+        writer->flush();
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    timer.stop();
+    long imported = domain.imported;
+    MPI_Reduce(root ? MPI_IN_PLACE : &imported, &imported, 1, MPI_LONG, MPI_SUM, 0,
+               MPI_COMM_WORLD);
+    if (root) {
+        std::cout << timer << std::endl;
+        if (DEBUG) {
+            std::cout << "Imported Point Masses: " << imported << " in last step" << std::endl;
+        }
+        std::ostringstream duration;
+        duration << timer.duration() << std::endl;
+        writeText(outfile, end, duration.str());
+        delete writer;
+        delete trajectory;
+    }
+    MPI_File_close(&outfile);
+
+    delete tree;
+    MPI_Finalize();
+    return 0;
+}
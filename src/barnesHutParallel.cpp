@@ -4,22 +4,28 @@
  * BarnesHutSimulation: barnesHut.cpp
  */
 
+#include "Affinity.h"
+#include "BlockIntegrator.h"
+#include "CostZones.h"
+#include "FastMultipole.h"
+#include "InputFile.h"
+#include "Kernels.h"
+#include "LinearOctTree.h"
 #include "OctTree.h"
+#include "Reorder.h"
+#include "SnapshotWriter.h"
 #include "Timer.h"
+#include "Trajectory.h"
+#include "UpdatePolicy.h"
+#include <algorithm>
 #include <fstream>
+#include <omp.h>
 #include <string>
 #include <vector>
 
 constexpr bool DEBUG = true;  // print debug output
 constexpr int DELTA = 1;      // length of time step: 1 second
 
-/* Read simulation bounds from input file */
-vector_3d getBounds(std::ifstream &f) {
-    double x, y, z;
-    f >> x >> y >> z;
-    return std::make_tuple(x, y, z);
-}
-
 int main(int argc, char *argv[]) {
     // Get command line args:
     //  steps     - number of time steps to simulate
@@ -48,9 +54,8 @@ int main(int argc, char *argv[]) {
         std::cout << "Output File: " << argv[3] << std::endl;
     }
 
-    // Open input file
-    std::ifstream infile;
-    infile.open(argv[2], std::ios::in);
+    // Open input file, text or binary (memory mapped)
+    InputFile infile(argv[2]);
     if (!infile.is_open()) {
         std::cerr << "Unable to open " << argv[2] << std::endl;
         exit(-1);
@@ -64,86 +69,264 @@ int main(int argc, char *argv[]) {
         exit(-1);
     }
     bool log = NULL != std::getenv("LOG");
+    bool fmm = NULL != std::getenv("FMM");  // dual-tree solver over LinearOctTree
+    bool leapfrog = NULL != std::getenv("LEAPFROG");  // block time steps over LinearOctTree
+    bool linear = fmm || leapfrog || NULL != std::getenv("LINEAR");
+    bool group = linear && NULL != std::getenv("GROUP");  // LinearOctTree walks once per group
+    int reorder = reorderInterval();
+
+    // Pin the team every step runs on before any particle or tree storage is
+    // first touched
+    int teamSize = omp_get_max_threads();
+    pinThreads(teamSize);
+    if (DEBUG) {
+        printPlacement(std::cout, teamSize);
+    }
 
-    // Parse input file and construct vector of Leaf objects
-    int numParticles;
-    infile >> numParticles;
-    vector_3d lowerBound = getBounds(infile);
-    vector_3d upperBound = getBounds(infile);
+    // Construct vector of Leaf objects from the input file. Leaves are
+    // allocated by all threads in static blocks, the first partition of the
+    // force loop, so each block is placed near the thread that walks it.
+    int numParticles = infile.size();
+    vector_3d lowerBound = infile.lower();
+    vector_3d upperBound = infile.upper();
     std::vector<Leaf *> particles(numParticles);
+    #pragma omp parallel for schedule(static)
     for (int i=0; i < numParticles; i++) {
-        particles[i] = new Leaf(nullptr, getBody(infile));
+        particles[i] = new Leaf(nullptr, infile.body(i));
+        particles[i]->index = i;
     }
-    infile.close();
 
-    // Write initial positions
+    // Write initial positions, as text with LOG and as a binary trajectory
+    // with TRAJECTORY. Time steps are written by a background thread while
+    // the simulation continues.
+    Trajectory *trajectory = openTrajectory(lowerBound);
+    SnapshotWriter *writer = nullptr;
     if (log) {
         outfile << numParticles << std::endl;
         outfile << steps << std::endl;
-        for (int i = 0; i < numParticles; i++) {
-            outfile << 0 << " ";
-            particles[i]->body.logBody(outfile);
-        }
+    }
+    if (log || trajectory != nullptr) {
+        writer = new SnapshotWriter(log ? &outfile : nullptr, trajectory);
+        writer->write(0, particles);
     }
 
     // Start timer
     Timer timer = Timer();
     timer.start();
 
-    // Construct OctTree from vector of particles
-    OctTree tree = OctTree(particles, lowerBound, upperBound);
-
-    // Update OctTree to cache center of mass for each octet at Root node
-    tree.setCenterOfMass();
+    // Construct OctTree (or LinearOctTree) from vector of particles. Root
+    // nodes freed by remove are recycled through the arena. LinearOctTree
+    // reads bodies from a struct of arrays copy of particles.
+    NodeArena arena(arenaPools());
+    OctTree *tree = nullptr;
+    LinearOctTree *linearTree = nullptr;
+    Particles *bodies = nullptr;
+    FastMultipole *solver = nullptr;
+    BlockIntegrator *integrator = nullptr;
+    if (linear) {
+        bodies = new Particles(particles);
+        linearTree = new LinearOctTree(*bodies, lowerBound, upperBound);
+        linearTree->setCenterOfMass();
+        solver = new FastMultipole(*linearTree);
+        integrator = new BlockIntegrator(*bodies, *linearTree);
+    } else {
+        tree = new OctTree(particles, lowerBound, upperBound, &arena);
+        tree->setCenterOfMass();
+    }
 
     // Perform Barnes-Hut simulation for given number of time steps
-    bool outOfBounds[numParticles];
+    std::vector<int> outOfBounds(numParticles);
+    std::vector<int> movedBefore(teamSize + 1);
+    std::vector<Leaf *> moved;
+    std::vector<Leaf *> ordered;
+    std::vector<int> treeIndex;  // particle index of each OctTree leaf in tree order
+    LeafStorage storage;
+    UpdatePolicy policy = UpdatePolicy();
+    CostZones zones = CostZones(numParticles);
     for (int i = 0; i < steps; i++) {
-        // for each particle, calculate total gravitational force and update accelerations
-        #pragma omp parallel for
-        for (int j = 0; j < numParticles; j++) {
-            vector_3d f = tree.treeForce(particles[j]);
-            particles[j]->body.apply(f);
-        }
+        // Periodically store particles in tree order, so that neighbouring
+        // iterations of the particle loops walk the same parts of the tree
+        bool reorderStep = reorder > 0 && (i + 1) % reorder == 0;
 
-        // simulate movement of time step
-        #pragma omp parallel for
-        for (int j = 0; j < numParticles; j++) {
-            particles[j]->body.move(DELTA);
-        }
+        // Each step runs in a single parallel region: the force, integration
+        // and tree update routines below are shared by its team (Parallel.h)
+        bool rebuild = false;
+        UpdateStrategy strategy = REBUILD;
+        Timer updateTimer = Timer();
+        #pragma omp parallel num_threads(teamSize)
+        {
+            // for each particle, calculate total gravitational force and update
+            // accelerations, then simulate movement of time step and find all
+            // particles that left their part of the tree
+            if (leapfrog) {
+                // forces and movement of every substep are done by the integrator
+                integrator->step(DELTA, true);
+                #pragma omp for reduction(|:rebuild)
+                for (int j = 0; j < numParticles; j++) {
+                    rebuild |= linearTree->checkParticleBounds(j);
+                }
+            } else if (fmm || group) {
+                if (fmm) {
+                    solver->forces(true);
+                } else {
+                    linearTree->groupForces(true);
+                }
+                #pragma omp for reduction(|:rebuild)
+                for (int j = 0; j < numParticles; j++) {
+                    bodies->moveParticle(j, DELTA);
+                    rebuild |= linearTree->checkParticleBounds(j);
+                }
+            } else if (linear) {
+                // Each thread walks a zone of particles with equal interaction
+                // counts in the last step, counting again for the next partition.
+                // Walks only read the tree's copy of the bodies, so every particle
+                // is moved and checked against its leaf right after its own walk.
+                #pragma omp single
+                zones.partition(&linearTree->treeOrder(), omp_get_num_threads());
+                #pragma omp for schedule(static, 1) reduction(|:rebuild)
+                for (int zone = 0; zone < zones.numZones(); zone++) {
+                    for (int s = zones.begin(zone); s < zones.end(zone); s++) {
+                        int j = zones.particle(s);
+                        int interactions = 0;
+                        bodies->apply(j, linearTree->treeForce(j, &interactions));
+                        zones.record(j, interactions);
+                        bodies->moveParticle(j, DELTA);
+                        rebuild |= linearTree->checkParticleBounds(j);
+                    }
+                }
+            } else {
+                // Zones follow the OctTree's leaf order, as for LinearOctTree.
+                // Walks read the leaves' positions, so particles only move once
+                // every walk is done. Out of bounds particles are then compacted
+                // in particle order from per-thread counts.
+                int t = omp_get_thread_num();
+                int numThreads = omp_get_num_threads();
+                tree->treeIndex(treeIndex);
+                #pragma omp single
+                zones.partition(&treeIndex, numThreads);
+                for (int zone = t; zone < zones.numZones(); zone += numThreads) {
+                    for (int s = zones.begin(zone); s < zones.end(zone); s++) {
+                        int j = zones.particle(s);
+                        int interactions = 0;
+                        particles[j]->body.apply(tree->treeForce(particles[j], &interactions));
+                        zones.record(j, interactions);
+                    }
+                }
+                #pragma omp barrier
 
-        // log new positions to file
-        if (log) {
-            for (int j = 0; j < numParticles; j++) {
-                outfile << i+1 << " ";
-                particles[j]->body.logBody(outfile);
+                int chunk = (numParticles + numThreads - 1) / numThreads;
+                int begin = std::min(numParticles, t * chunk);
+                int end = std::min(numParticles, begin + chunk);
+                int count = 0;
+                for (int j = begin; j < end; j++) {
+                    particles[j]->body.move(DELTA);
+                    outOfBounds[j] = !reorderStep && tree->checkParticleBounds(particles[j]);
+                    count += outOfBounds[j];
+                }
+                movedBefore[t + 1] = count;
+                #pragma omp barrier
+                #pragma omp single
+                {
+                    movedBefore[0] = 0;
+                    for (int k = 1; k <= numThreads; k++) {
+                        movedBefore[k] += movedBefore[k - 1];
+                    }
+                    moved.resize(movedBefore[numThreads]);
+                }
+                int k = movedBefore[t];
+                for (int j = begin; j < end; j++) {
+                    if (outOfBounds[j]) {
+                        moved[k++] = particles[j];
+                    }
+                }
             }
-        }
 
-        // find all out of bounds particles
-        #pragma omp parallel for
-        for (int j = 0; j < numParticles; j++) {
-            outOfBounds[j] = tree.checkParticleBounds(particles[j]);
-        }
+            // log new positions to file
+            if (writer != nullptr && linear) {
+                writer->write(i+1, *bodies);
+            } else if (writer != nullptr) {
+                writer->write(i+1, particles);
+            }
+
+            if (linear) {
+                // LinearOctTree is rebuilt if any particle left its leaf
+                if (reorderStep && leapfrog) {
+                    integrator->reorder(linearTree->treeOrder());
+                } else if (reorderStep) {
+                    #pragma omp single
+                    zones.permute(linearTree->treeOrder());
+                    bodies->permute(linearTree->treeOrder());
+                }
+                if (rebuild || reorderStep) {
+                    linearTree->build();
+                }
+
+                // Update LinearOctTree to cache center of mass for each node
+                linearTree->setCenterOfMass();
+            } else if (reorderStep) {
+                #pragma omp single
+                tree->treeOrder(ordered);
+                reorderParticles(particles, ordered, storage);
+                #pragma omp single
+                zones.reset();
+                tree->rebuild(particles);
+                tree->setCenterOfMass();
+            } else {
+                // Rebuild tree or remove and re-insert out of bounds particles,
+                // whichever the measured cost model predicts is cheaper
+                #pragma omp single
+                {
+                    strategy = policy.choose((int)moved.size());
+                    updateTimer.start();
+                }
+                if (strategy == REBUILD) {
+                    tree->rebuild(particles);
+                } else {
+                    tree->reinsertParticles(moved);
+                }
+                #pragma omp barrier
+                #pragma omp single
+                {
+                    updateTimer.stop();
+                    policy.record(strategy, (int)moved.size(), updateTimer.duration());
+                }
 
-        // Remove and re-insert out of bounds particles
-        for (int j = 0; j < numParticles; j++) {
-            if (outOfBounds[j]) {
-                tree.remove(particles[j]);
-                tree.insert(particles[j]);
+                // Update OctTree to cache center of mass for each octet at Root node
+                tree->setCenterOfMass();
             }
         }
-
-        // Update OctTree to cache center of mass for each octet at Root node
-        tree.setCenterOfMass();
     }
 
+    // Logged steps still count towards the time of the simulation
+    if (writer != nullptr) {
+        writer->flush();
+    }
     timer.stop();
     std::cout << timer << std::endl;
+    if (DEBUG && !linear) {
+        std::cout << "Tree Nodes: " << arena.nodesInUse() << " (" <<
+            arena.bytesReserved() << " bytes reserved)" << std::endl;
+        std::cout << "Tree Updates: " << policy.rebuilds << " rebuilds, " <<
+            policy.incrementals << " incremental" << std::endl;
+    }
+    if (DEBUG && linear) {
+        std::cout << "Kernels: " << kernelName() << std::endl;
+    }
+    if (DEBUG && leapfrog) {
+        std::cout << "Force Evaluations: " << integrator->forceEvaluations <<
+            " in last step" << std::endl;
+    }
     outfile << timer.duration() << std::endl;
 
-    // Close output file and free memory allocated for particles
+    // Close output file and free memory allocated for tree and particles
+    delete writer;
+    delete trajectory;
     outfile.close();
+    delete tree;
+    delete integrator;
+    delete solver;
+    delete bodies;
+    delete linearTree;
     particles.clear();
 
     return 0;
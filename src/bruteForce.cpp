@@ -1,26 +1,27 @@
 /*
  * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
  *
- * BarnesHutSimulation: main.cpp
+ * BarnesHutSimulation: bruteForce.cpp
  */
 
+#include "Affinity.h"
 #include "Body.h"
+#include "DirectSum.h"
+#include "InputFile.h"
+#include "Kernels.h"
 #include "Node.h"
+#include "Particles.h"
+#include "SnapshotWriter.h"
 #include "Timer.h"
+#include "Trajectory.h"
 #include <fstream>
+#include <omp.h>
 #include <string>
 #include <vector>
 
 constexpr bool DEBUG = true;  // print debug output
 constexpr int DELTA = 1;      // length of time step: 1 second
 
-/* Read simulation bounds from input file */
-vector_3d getBounds(std::ifstream &f) {
-    double x, y, z;
-    f >> x >> y >> z;
-    return std::make_tuple(x, y, z);
-}
-
 int main(int argc, char *argv[]) {
     // Get command line args:
     //  steps     - number of time steps to simulate
@@ -49,9 +50,8 @@ int main(int argc, char *argv[]) {
         std::cout << "Output File: " << argv[3] << std::endl;
     }
 
-    // Open input file
-    std::ifstream infile;
-    infile.open(argv[2], std::ios::in);
+    // Open input file, text or binary (memory mapped)
+    InputFile infile(argv[2]);
     if (!infile.is_open()) {
         std::cerr << "Unable to open " << argv[2] << std::endl;
         exit(-1);
@@ -65,26 +65,37 @@ int main(int argc, char *argv[]) {
         exit(-1);
     }
     bool log = NULL != std::getenv("LOG");
+    bool parallel = NULL == std::getenv("SEQ");
+
+    // Pin threads before particle storage is first touched by Particles
+    if (parallel) {
+        pinThreads(omp_get_max_threads());
+        if (DEBUG) {
+            printPlacement(std::cout, omp_get_max_threads());
+        }
+    }
 
-    // Parse input file and construct vector of Leaf objects
-    int numParticles;
-    infile >> numParticles;
-    getBounds(infile); // lower bounds not used
-    getBounds(infile); // upper bounds not used
+    // Construct vector of Leaf objects from the input file (bounds not used)
+    int numParticles = infile.size();
     std::vector<Leaf *> particles(numParticles);
     for (int i=0; i < numParticles; i++) {
-        particles[i] = new Leaf(nullptr, getBody(infile));
+        particles[i] = new Leaf(nullptr, infile.body(i));
     }
-    infile.close();
-
-    // Write initial positions
+    Particles *bodies = new Particles(particles);
+    DirectSum solver(*bodies);
+
+    // Write initial positions, as text with LOG and as a binary trajectory
+    // with TRAJECTORY. Time steps are written by a background thread while
+    // the simulation continues.
+    Trajectory *trajectory = openTrajectory(infile.lower());
+    SnapshotWriter *writer = nullptr;
     if (log) {
         outfile << numParticles << std::endl;
         outfile << steps << std::endl;
-        for (int i = 0; i < numParticles; i++) {
-            outfile << 0 << " ";
-            particles[i]->body.logBody(outfile);
-        }
+    }
+    if (log || trajectory != nullptr) {
+        writer = new SnapshotWriter(log ? &outfile : nullptr, trajectory);
+        writer->write(0, *bodies);
     }
 
     // Start timer
@@ -93,35 +104,36 @@ int main(int argc, char *argv[]) {
 
     // simulate movement on all bodies for given number of time steps
     for (int i = 0; i < steps; i++) {
-        // sequentially calculate all pairwise gravitational forces and apply them,
+        // calculate all pairwise gravitational forces and apply them,
         // this will update all bodies' acceleration vectors in prep for next movement sim
-        for (int j = 0; j < numParticles; j++) {
-            for (int k = 0; k < numParticles; k++) {
-                if (j != k) {
-                    particles[j]->body.force(particles[k]->body);
-                }
-            }
-        }
+        solver.forces(parallel);
         // simulate movement of time step
-        for (int j = 0; j < numParticles; j++) {
-            particles[j]->body.move(DELTA);
-        }
+        bodies->move(DELTA, parallel);
         // log new positions to file
-        if (log) {
-            for (int j = 0; j < numParticles; j++) {
-                outfile << i+1 << " ";
-                particles[j]->body.logBody(outfile);
-            }
+        if (writer != nullptr) {
+            writer->write(i+1, *bodies);
         }
     }
 
+    // Logged steps still count towards the time of the simulation
+    if (writer != nullptr) {
+        writer->flush();
+    }
     timer.stop();
     std::cout << timer << std::endl;
     outfile << timer.duration() << std::endl;
-
+    if (DEBUG) {
+        std::cout << "Kernels: " << kernelName() << std::endl;
+    }
 
     // Close output file and free memory allocated for particles
+    delete writer;
+    delete trajectory;
     outfile.close();
+    delete bodies;
+    for (int i = 0; i < numParticles; i++) {
+        delete particles[i];
+    }
     particles.clear();
 
     return 0;
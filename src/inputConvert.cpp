@@ -0,0 +1,33 @@
+/*
+ * Copyright 2020 Bryson Banks, David Campbell, and Jeffrey Nelson.  All rights reserved.
+ *
+ * BarnesHutSimulation: inputConvert.cpp
+ */
+
+#include "InputFile.h"
+#include <vector>
+
+// Converts a text input file to the binary input format. Build with the
+// default DIM=3, since a planar build drops z components on reading.
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: ./inputConvert <text_input_filename> <binary_output_filename>"
+                  << std::endl;
+        exit(-1);
+    }
+
+    InputFile infile(argv[1]);
+    if (!infile.is_open()) {
+        std::cerr << "Unable to open " << argv[1] << std::endl;
+        exit(-1);
+    }
+    std::vector<Body> bodies(infile.size());
+    for (int i = 0; i < infile.size(); i++) {
+        bodies[i] = infile.body(i);
+    }
+    if (!writeBinaryInput(argv[2], bodies, infile.lower(), infile.upper())) {
+        exit(-1);
+    }
+    std::cout << "Converted " << bodies.size() << " bodies" << std::endl;
+    return 0;
+}
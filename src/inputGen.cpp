@@ -5,10 +5,12 @@
  */
 
 #include "Body.h"
+#include "InputFile.h"
 #include "Timer.h"
 #include <ctime>
 #include <math.h>
 #include <fstream>
+#include <vector>
 
 #define XRANGE (290*pow(10, 12)) // approximate width of solar system in meters
 #define YRANGE (290*pow(10, 12))
@@ -48,22 +50,27 @@ int main(int argc, char* argv[]) {
     Timer timer = Timer();
     timer.start();
 
-    // Open output file
+    // Open output file. With BINARY set, bodies are written in the binary
+    // input format once all are generated, otherwise as text while generated.
+    bool binary = NULL != getenv("BINARY");
     ofstream outfilep;
     char *outputfile = argv[1];
-    outfilep.open(outputfile, ios::out);
-
-    if (!outfilep.is_open()) {
-        cout << "ERROR: could not open file " << outputfile << endl;
-        exit(-1);
+    if (!binary) {
+        outfilep.open(outputfile, ios::out);
+        if (!outfilep.is_open()) {
+            cout << "ERROR: could not open file " << outputfile << endl;
+            exit(-1);
+        }
     }
 
     // Write number of bodies to be generated to output file
     int num_bodies = stoi(argv[2]);
-    outfilep << num_bodies << endl;
-    // Write simulation bounds to output file
-    outfilep << 0 << " " << 0 << " " << 0 << endl;
-    outfilep << XRANGE << " " << YRANGE << " " << ZRANGE << endl;
+    if (!binary) {
+        outfilep << num_bodies << endl;
+        // Write simulation bounds to output file
+        outfilep << 0 << " " << 0 << " " << 0 << endl;
+        outfilep << XRANGE << " " << YRANGE << " " << ZRANGE << endl;
+    }
 
     // Seed random number generator and print seed
     char *seed = getenv("RAND_SEED");
@@ -104,11 +111,21 @@ int main(int argc, char* argv[]) {
         if (bodiesInMinRange(bodies, i, bodies[i])) {
             continue;
         } else {
-            bodies[i].logBody(outfilep);
+            if (!binary) {
+                bodies[i].logBody(outfilep);
+            }
             i++;
         }
     }
-    outfilep.close();
+    if (binary) {
+        vector<Body> generated(bodies, bodies + num_bodies);
+        if (!writeBinaryInput(outputfile, generated, make_tuple(0.0, 0.0, 0.0),
+                              make_tuple(XRANGE, YRANGE, ZRANGE))) {
+            exit(-1);
+        }
+    } else {
+        outfilep.close();
+    }
     delete []bodies;
 
     timer.stop();
@@ -0,0 +1,151 @@
+#!/usr/bin/python
+
+# Reader for binary trajectories written by the simulations with
+# TRAJECTORY=<file> (see include/Trajectory.h for the layout).
+#
+#   t = Trajectory("run.traj")
+#   frame = t.frame(len(t) - 1)   # {'step': ..., 'pos': (count, 3) array, ...}
+#
+# Frames are found through the index at the end of the file, or by walking
+# the frame headers when the run was cut short.
+
+import mmap
+import struct
+import sys
+
+import numpy as np
+
+MAGIC = b"BHTRAJ\0\0"
+INDEX_MAGIC = b"BHTINDEX"
+VERSION = 1
+
+FIELD_POS = 1
+FIELD_VEL = 2
+FIELD_ACC = 4
+FIELD_MASS = 8
+
+FRAME_RAW = 0
+FRAME_KEY = 1
+FRAME_DELTA = 2
+
+HEADER = struct.Struct("<8sIIQII4d")  # magic, version, fields, count, keyframe, reserved, quantum, origin
+FRAME = struct.Struct("<iIQQ")        # step, encoding, posBytes, bytes
+TRAILER = struct.Struct("<QQ8s")      # indexOffset, frames, magic
+
+
+def is_trajectory(path):
+    with open(path, "rb") as f:
+        return f.read(len(MAGIC)) == MAGIC
+
+
+def _varints(buf):
+    """Decode a run of zigzag varints into an int64 array"""
+    b = np.frombuffer(buf, dtype=np.uint8)
+    if len(b) == 0:
+        return np.zeros(0, dtype=np.int64)
+    ends = np.flatnonzero(b < 0x80)
+    starts = np.concatenate(([0], ends[:-1] + 1))
+    shift = (np.arange(len(b)) - np.repeat(starts, ends - starts + 1)) * 7
+    v = np.add.reduceat((b & 0x7F).astype(np.uint64) << shift.astype(np.uint64), starts)
+    return (v >> np.uint64(1)).astype(np.int64) ^ -(v & np.uint64(1)).astype(np.int64)
+
+
+class Trajectory:
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self._map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        (magic, version, self.fields, self.count, self.keyframe, _, self.quantum,
+         ox, oy, oz) = HEADER.unpack_from(self._map, 0)
+        if magic != MAGIC:
+            raise ValueError("%s is not a trajectory" % path)
+        if version != VERSION:
+            raise ValueError("trajectory version %d is not supported" % version)
+        self.origin = np.array([ox, oy, oz])
+        self.ids = np.frombuffer(self._map, dtype="<i4", count=self.count, offset=HEADER.size)
+        first = HEADER.size + (4 * self.count + 7) // 8 * 8
+        self.offsets = self._index(first)
+        self.steps = [FRAME.unpack_from(self._map, o)[0] for o in self.offsets]
+        self._cached = None  # (frame, grid coordinates) of the last quantized frame read
+
+    def _index(self, first):
+        size = len(self._map)
+        if size >= first + TRAILER.size:
+            index, frames, magic = TRAILER.unpack_from(self._map, size - TRAILER.size)
+            if magic == INDEX_MAGIC and index + 8 * frames + TRAILER.size == size:
+                return np.frombuffer(self._map, dtype="<u8", count=frames,
+                                     offset=index).astype(np.int64).tolist()
+        offsets = []
+        o = first
+        while o + FRAME.size <= size:
+            nbytes = FRAME.unpack_from(self._map, o)[3]
+            if o + FRAME.size + nbytes > size:
+                break
+            offsets.append(o)
+            o += FRAME.size + nbytes
+        return offsets
+
+    def __len__(self):
+        return len(self.offsets)
+
+    def _columns(self):
+        """Number of double columns before the positions of a frame"""
+        return (3 * bool(self.fields & FIELD_VEL) + 3 * bool(self.fields & FIELD_ACC) +
+                bool(self.fields & FIELD_MASS))
+
+    def _positions(self, k):
+        """Encoding and encoded positions of frame k"""
+        o = self.offsets[k]
+        _, encoding, pos_bytes, _ = FRAME.unpack_from(self._map, o)
+        o += FRAME.size + 8 * self.count * self._columns()
+        if encoding == FRAME_RAW:
+            return encoding, np.frombuffer(self._map, dtype="<f8", count=3 * self.count, offset=o)
+        return encoding, _varints(self._map[o:o + pos_bytes])
+
+    def _grid(self, k):
+        """Grid coordinates of quantized frame k, decoded from the last key frame"""
+        start = k
+        while FRAME.unpack_from(self._map, self.offsets[start])[1] == FRAME_DELTA:
+            start -= 1
+        if self._cached is not None and start <= self._cached[0] <= k:
+            start, grid = self._cached
+        else:
+            grid = self._positions(start)[1]
+        for j in range(start + 1, k + 1):
+            grid = grid + self._positions(j)[1]
+        self._cached = (k, grid)
+        return grid
+
+    def frame(self, k):
+        """Step and selected fields of frame k, vectors as (count, 3) arrays in id order"""
+        o = self.offsets[k]
+        step, encoding, _, _ = FRAME.unpack_from(self._map, o)
+        o += FRAME.size
+        n = self.count
+        frame = {"step": step}
+        for name, bit, width in (("vel", FIELD_VEL, 3), ("acc", FIELD_ACC, 3),
+                                 ("mass", FIELD_MASS, 1)):
+            if self.fields & bit:
+                values = np.frombuffer(self._map, dtype="<f8", count=width * n, offset=o)
+                frame[name] = values.reshape(3, n).T if width == 3 else values
+                o += 8 * width * n
+        if self.fields & FIELD_POS:
+            if encoding == FRAME_RAW:
+                frame["pos"] = self._positions(k)[1].reshape(3, n).T
+            else:
+                frame["pos"] = self.origin + self._grid(k).reshape(3, n).T * self.quantum
+        return frame
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Usage: ./trajectory.py <file>")
+        sys.exit(1)
+    t = Trajectory(sys.argv[1])
+    names = [name for name, bit in (("pos", FIELD_POS), ("vel", FIELD_VEL), ("acc", FIELD_ACC),
+                                    ("mass", FIELD_MASS)) if t.fields & bit]
+    print("Bodies: %d" % t.count)
+    print("Frames: %d (steps %s to %s)" % (len(t), t.steps[0] if t.steps else "-",
+                                           t.steps[-1] if t.steps else "-"))
+    print("Fields: %s" % ",".join(names))
+    print("Quantum: %g" % t.quantum)
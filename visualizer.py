@@ -5,25 +5,33 @@ matplotlib.use('Agg') # Set non GUI based backend
 import matplotlib.pyplot as plt
 from matplotlib.animation import FuncAnimation
 import sys
+import trajectory
 
 if len(sys.argv) < 2:
     print("Usage: ./visualizer.py <file>")
     sys.exit(1)
 
-data = open(sys.argv[1], "r")
-# Skip first two lines and last line of file
-lines = data.readlines()[2:-1]
-
 particles = {}
-for line in lines:
-    # Split on space and grab time step and position
-    lineSplit = line.split()
-    timeStep = int(lineSplit[0])
-    posx, posy= lineSplit[3:5]
-    # Insert position into dictionary
-    if timeStep not in particles:
-        particles[timeStep] = []
-    particles[timeStep].append((float(posx), float(posy)))
+if trajectory.is_trajectory(sys.argv[1]):
+    # Binary trajectory written with TRAJECTORY=<file>
+    traj = trajectory.Trajectory(sys.argv[1])
+    for k in range(len(traj)):
+        frame = traj.frame(k)
+        particles[frame['step']] = [(x, y) for x, y in frame['pos'][:, :2]]
+else:
+    data = open(sys.argv[1], "r")
+    # Skip first two lines and last line of file
+    lines = data.readlines()[2:-1]
+
+    for line in lines:
+        # Split on space and grab time step and position
+        lineSplit = line.split()
+        timeStep = int(lineSplit[0])
+        posx, posy= lineSplit[3:5]
+        # Insert position into dictionary
+        if timeStep not in particles:
+            particles[timeStep] = []
+        particles[timeStep].append((float(posx), float(posy)))
 
 # Plot parameters
 plt.style.use('dark_background')